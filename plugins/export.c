@@ -285,6 +285,20 @@ static void write_data(const gchar *filename, const gchar *data)
 }
 
 
+/* Styles the rest of the document, Geany only styles the text beyond the view when idle */
+static void ensure_styled(ScintillaObject *sci)
+{
+	gint end_styled = scintilla_send_message(sci, SCI_GETENDSTYLED, 0, 0);
+
+	if (end_styled < sci_get_length(sci))
+	{
+		gint start = sci_get_position_from_line(sci, sci_get_line_from_position(sci, end_styled));
+
+		scintilla_send_message(sci, SCI_COLOURISE, (uptr_t) start, -1);
+	}
+}
+
+
 static gchar *get_date(gint type)
 {
 	const gchar *format;
@@ -390,6 +404,7 @@ static void write_latex_file(GeanyDocument *doc, const gchar *filename,
 		line_number_max_width = get_line_number_width(doc);
 
 	/* read the document and write the LaTeX code */
+	ensure_styled(sci);
 	body = g_string_new("");
 	doc_len = sci_get_length(sci);
 	for (i = 0; i < doc_len; i++)
@@ -603,6 +618,7 @@ static void write_html_file(GeanyDocument *doc, const gchar *filename,
 		line_number_max_width = get_line_number_width(doc);
 
 	/* read the document and write the HTML body */
+	ensure_styled(sci);
 	body = g_string_new("");
 	doc_len = sci_get_length(sci);
 	for (i = 0; i < doc_len; i++)
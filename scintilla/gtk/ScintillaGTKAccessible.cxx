@@ -158,12 +158,14 @@ ScintillaGTKAccessible::ScintillaGTKAccessible(GtkAccessible *accessible_, GtkWi
 		sci(ScintillaGTK::FromWidget(widget_)),
 		deletionLengthChar(0),
 		old_pos(-1) {
+	sci->pdoc->AllocateLineCharacterIndex(SC_LINECHARACTERINDEX_UTF32);
 	g_signal_connect(widget_, "sci-notify", G_CALLBACK(SciNotify), this);
 }
 
 ScintillaGTKAccessible::~ScintillaGTKAccessible() {
 	if (gtk_accessible_get_widget(accessible)) {
 		g_signal_handlers_disconnect_matched(sci->sci, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, this);
+		sci->pdoc->ReleaseLineCharacterIndex(SC_LINECHARACTERINDEX_UTF32);
 	}
 }
 
@@ -426,6 +428,9 @@ gunichar ScintillaGTKAccessible::GetCharacterAtOffset(int charOffset) {
 }
 
 gint ScintillaGTKAccessible::GetCharacterCount() {
+	if (UseLineCharacterIndex()) {
+		return sci->pdoc->IndexLineStart(sci->pdoc->LinesTotal(), SC_LINECHARACTERINDEX_UTF32);
+	}
 	return sci->pdoc->CountCharacters(0, sci->pdoc->Length());
 }
 
@@ -826,11 +831,15 @@ void ScintillaGTKAccessible::ChangeDocument(Document *oldDoc, Document *newDoc)
 	if (oldDoc) {
 		int charLength = oldDoc->CountCharacters(0, oldDoc->Length());
 		g_signal_emit_by_name(accessible, "text-changed::delete", 0, charLength);
+		oldDoc->ReleaseLineCharacterIndex(SC_LINECHARACTERINDEX_UTF32);
 	}
+	character_offsets.clear();
 
 	if (newDoc) {
 		PLATFORM_ASSERT(newDoc == sci->pdoc);
 
+		newDoc->AllocateLineCharacterIndex(SC_LINECHARACTERINDEX_UTF32);
+
 		int charLength = newDoc->CountCharacters(0, newDoc->Length());
 		g_signal_emit_by_name(accessible, "text-changed::insert", 0, charLength);
 
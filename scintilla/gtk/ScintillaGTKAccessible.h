@@ -20,7 +20,8 @@ private:
 	GtkAccessible *accessible;
 	ScintillaGTK *sci;
 
-	// cache holding character offset for each line start, see CharacterOffsetFromByteOffset()
+	// cache holding character offset for each line start, see CharacterOffsetFromByteOffset().
+	// Only used when the document's line character index can't be, see UseLineCharacterIndex()
 	std::vector<Position> character_offsets;
 
 	// cached length of the deletion, in characters (see Notify())
@@ -50,12 +51,28 @@ private:
 		return pos;
 	}
 
+	// the document's line character index counts UTF-8 characters or bytes, so it matches
+	// CountCharacters() for all but DBCS code pages
+	bool UseLineCharacterIndex() {
+		return sci->pdoc->dbcsCodePage == 0 || sci->pdoc->dbcsCodePage == SC_CP_UTF8;
+	}
+
 	Position ByteOffsetFromCharacterOffset(int characterOffset) {
+		if (UseLineCharacterIndex()) {
+			const int line = sci->pdoc->LineFromPositionIndex(characterOffset, SC_LINECHARACTERINDEX_UTF32);
+			const int lineStartChar = sci->pdoc->IndexLineStart(line, SC_LINECHARACTERINDEX_UTF32);
+			return ByteOffsetFromCharacterOffset(sci->pdoc->LineStart(line), characterOffset - lineStartChar);
+		}
 		return ByteOffsetFromCharacterOffset(0, characterOffset);
 	}
 
 	int CharacterOffsetFromByteOffset(Position byteOffset) {
 		const Position line = sci->pdoc->LineFromPosition(byteOffset);
+		if (UseLineCharacterIndex()) {
+			const Position lineStart = sci->pdoc->LineStart(line);
+			return sci->pdoc->IndexLineStart(line, SC_LINECHARACTERINDEX_UTF32) +
+				sci->pdoc->CountCharacters(lineStart, byteOffset);
+		}
 		if (character_offsets.size() <= static_cast<size_t>(line)) {
 			if (character_offsets.empty())
 				character_offsets.push_back(0);
@@ -26,6 +26,47 @@
 using namespace Scintilla;
 #endif
 
+LineStartIndex::LineStartIndex() : refCount(0), starts(4) {
+}
+
+/// Returns true when the index has just been allocated and so has to be calculated.
+bool LineStartIndex::Allocate(int lines) {
+	refCount++;
+	int length = starts.PositionFromPartition(starts.Partitions());
+	for (int line = starts.Partitions(); line < lines; line++) {
+		// Temporary values, calculated by the caller
+		length++;
+		starts.InsertPartition(line, length);
+	}
+	return refCount == 1;
+}
+
+/// Returns true when the last reference has gone and the index has been freed.
+bool LineStartIndex::Release() {
+	if (refCount == 1) {
+		starts.DeleteAll();
+	}
+	refCount--;
+	return refCount == 0;
+}
+
+int LineStartIndex::LineWidth(int line) const {
+	return starts.PositionFromPartition(line + 1) -
+		starts.PositionFromPartition(line);
+}
+
+void LineStartIndex::SetLineWidth(int line, int width) {
+	starts.InsertText(line, width - LineWidth(line));
+}
+
+void LineStartIndex::InsertLines(int line, int lines) {
+	// Insert empty lines, their widths are set afterwards
+	const int position = starts.PositionFromPartition(line);
+	for (int l = 0; l < lines; l++) {
+		starts.InsertPartition(line + l, position);
+	}
+}
+
 LineVector::LineVector() : starts(256), perLine(0) {
 	Init();
 }
@@ -39,6 +80,12 @@ void LineVector::Init() {
 	if (perLine) {
 		perLine->Init();
 	}
+	if (startsUTF32.Active()) {
+		startsUTF32.starts.DeleteAll();
+	}
+	if (startsUTF16.Active()) {
+		startsUTF16.starts.DeleteAll();
+	}
 }
 
 void LineVector::SetPerLine(PerLine *pl) {
@@ -51,6 +98,12 @@ void LineVector::InsertText(int line, int delta) {
 
 void LineVector::InsertLine(int line, int position, bool lineStart) {
 	starts.InsertPartition(line, position);
+	if (startsUTF32.Active()) {
+		startsUTF32.InsertLines(line, 1);
+	}
+	if (startsUTF16.Active()) {
+		startsUTF16.InsertLines(line, 1);
+	}
 	if (perLine) {
 		if ((line > 0) && lineStart)
 			line--;
@@ -64,6 +117,12 @@ void LineVector::SetLineStart(int line, int position) {
 
 void LineVector::RemoveLine(int line) {
 	starts.RemovePartition(line);
+	if (startsUTF32.Active()) {
+		startsUTF32.starts.RemovePartition(line);
+	}
+	if (startsUTF16.Active()) {
+		startsUTF16.starts.RemovePartition(line);
+	}
 	if (perLine) {
 		perLine->RemoveLine(line);
 	}
@@ -73,6 +132,75 @@ int LineVector::LineFromPosition(int pos) const {
 	return starts.PartitionFromPosition(pos);
 }
 
+int LineVector::LineCharacterIndex() const {
+	int lineCharacterIndex = SC_LINECHARACTERINDEX_NONE;
+	if (startsUTF32.Active()) {
+		lineCharacterIndex |= SC_LINECHARACTERINDEX_UTF32;
+	}
+	if (startsUTF16.Active()) {
+		lineCharacterIndex |= SC_LINECHARACTERINDEX_UTF16;
+	}
+	return lineCharacterIndex;
+}
+
+/// Returns true when an index has just been allocated and so has to be calculated.
+bool LineVector::AllocateLineCharacterIndex(int lineCharacterIndex, int lines) {
+	bool changed = false;
+	if ((lineCharacterIndex & SC_LINECHARACTERINDEX_UTF32) != 0) {
+		changed = startsUTF32.Allocate(lines) || changed;
+	}
+	if ((lineCharacterIndex & SC_LINECHARACTERINDEX_UTF16) != 0) {
+		changed = startsUTF16.Allocate(lines) || changed;
+	}
+	return changed;
+}
+
+bool LineVector::ReleaseLineCharacterIndex(int lineCharacterIndex) {
+	bool changed = false;
+	if (((lineCharacterIndex & SC_LINECHARACTERINDEX_UTF32) != 0) && startsUTF32.Active()) {
+		changed = startsUTF32.Release() || changed;
+	}
+	if (((lineCharacterIndex & SC_LINECHARACTERINDEX_UTF16) != 0) && startsUTF16.Active()) {
+		changed = startsUTF16.Release() || changed;
+	}
+	return changed;
+}
+
+int LineVector::IndexLineStart(int line, int lineCharacterIndex) const {
+	const LineStartIndex &index = (lineCharacterIndex == SC_LINECHARACTERINDEX_UTF32) ?
+		startsUTF32 : startsUTF16;
+	if (!index.Active())
+		return 0;
+	line = std::max(0, std::min(line, index.starts.Partitions()));
+	return index.starts.PositionFromPartition(line);
+}
+
+int LineVector::LineFromPositionIndex(int pos, int lineCharacterIndex) const {
+	const LineStartIndex &index = (lineCharacterIndex == SC_LINECHARACTERINDEX_UTF32) ?
+		startsUTF32 : startsUTF16;
+	if (!index.Active())
+		return 0;
+	return index.starts.PartitionFromPosition(pos);
+}
+
+void LineVector::SetLineCharactersWidth(int line, const CountWidths &width) {
+	if (startsUTF32.Active()) {
+		startsUTF32.SetLineWidth(line, width.countCharacters);
+	}
+	if (startsUTF16.Active()) {
+		startsUTF16.SetLineWidth(line, width.countUTF16);
+	}
+}
+
+void LineVector::InsertCharacters(int line, const CountWidths &delta) {
+	if (startsUTF32.Active()) {
+		startsUTF32.starts.InsertText(line, delta.countCharacters);
+	}
+	if (startsUTF16.Active()) {
+		startsUTF16.starts.InsertText(line, delta.countUTF16);
+	}
+}
+
 Action::Action() {
 	at = startAction;
 	position = 0;
@@ -368,6 +496,7 @@ void UndoHistory::CompletedRedoStep() {
 
 CellBuffer::CellBuffer() {
 	readOnly = false;
+	utf8Substance = false;
 	utf8LineEnds = 0;
 	collectingUndo = true;
 }
@@ -489,6 +618,15 @@ void CellBuffer::Allocate(int newSize) {
 	style.ReAllocate(newSize);
 }
 
+void CellBuffer::SetUTF8Substance(bool utf8Substance_) {
+	if (utf8Substance != utf8Substance_) {
+		utf8Substance = utf8Substance_;
+		if (lv.LineCharacterIndex() != SC_LINECHARACTERINDEX_NONE) {
+			RecalculateIndexLineStarts(0, Lines() - 1);
+		}
+	}
+}
+
 void CellBuffer::SetLineEndTypes(int utf8LineEnds_) {
 	if (utf8LineEnds != utf8LineEnds_) {
 		utf8LineEnds = utf8LineEnds_;
@@ -574,6 +712,29 @@ void CellBuffer::RemoveLine(int line) {
 	lv.RemoveLine(line);
 }
 
+int CellBuffer::LineCharacterIndex() const {
+	return lv.LineCharacterIndex();
+}
+
+void CellBuffer::AllocateLineCharacterIndex(int lineCharacterIndex) {
+	if (lv.AllocateLineCharacterIndex(lineCharacterIndex, Lines())) {
+		// Changed so recalculate whole file
+		RecalculateIndexLineStarts(0, Lines() - 1);
+	}
+}
+
+void CellBuffer::ReleaseLineCharacterIndex(int lineCharacterIndex) {
+	lv.ReleaseLineCharacterIndex(lineCharacterIndex);
+}
+
+int CellBuffer::IndexLineStart(int line, int lineCharacterIndex) const {
+	return lv.IndexLineStart(line, lineCharacterIndex);
+}
+
+int CellBuffer::LineFromPositionIndex(int pos, int lineCharacterIndex) const {
+	return lv.LineFromPositionIndex(pos, lineCharacterIndex);
+}
+
 bool CellBuffer::UTF8LineEndOverlaps(int position) const {
 	unsigned char bytes[] = {
 		static_cast<unsigned char>(substance.ValueAt(position-2)),
@@ -618,6 +779,54 @@ void CellBuffer::ResetLineEnds() {
 		chBeforePrev = chPrev;
 		chPrev = ch;
 	}
+	if (lv.LineCharacterIndex() != SC_LINECHARACTERINDEX_NONE) {
+		RecalculateIndexLineStarts(0, Lines() - 1);
+	}
+}
+
+/// Counts the characters and UTF-16 code units from position, returning false when
+/// invalid UTF-8 was found. Invalid bytes count as one character each, as in Document.
+bool CellBuffer::CountCharacterWidths(int position, int length, CountWidths &widths) const {
+	if (!utf8Substance) {
+		widths.countCharacters += length;
+		widths.countUTF16 += length;
+		return true;
+	}
+	bool valid = true;
+	const int end = position + length;
+	while (position < end) {
+		const unsigned char ch = substance.ValueAt(position);
+		int width = 1;
+		if (!UTF8IsAscii(ch)) {
+			unsigned char bytes[UTF8MaxBytes] = { ch, 0, 0, 0 };
+			const int available = std::min(end - position, UTF8MaxBytes);
+			for (int b = 1; b < available; b++) {
+				bytes[b] = substance.ValueAt(position + b);
+			}
+			const int utf8Status = UTF8Classify(bytes, available);
+			if (utf8Status & UTF8MaskInvalid) {
+				valid = false;
+			} else {
+				width = utf8Status & UTF8MaskWidth;
+			}
+		}
+		widths.countCharacters++;
+		// Characters outside the BMP are a surrogate pair in UTF-16
+		widths.countUTF16 += (width == UTF8MaxBytes) ? 2 : 1;
+		position += width;
+	}
+	return valid;
+}
+
+void CellBuffer::RecalculateIndexLineStarts(int lineFirst, int lineLast) {
+	lineFirst = std::max(lineFirst, 0);
+	lineLast = std::min(lineLast, Lines() - 1);
+	for (int line = lineFirst; line <= lineLast; line++) {
+		const int lineStart = LineStart(line);
+		CountWidths widths;
+		CountCharacterWidths(lineStart, LineStart(line + 1) - lineStart, widths);
+		lv.SetLineCharactersWidth(line, widths);
+	}
 }
 
 void CellBuffer::BasicInsertString(int position, const char *s, int insertLength) {
@@ -634,6 +843,7 @@ void CellBuffer::BasicInsertString(int position, const char *s, int insertLength
 	substance.InsertFromArray(position, s, 0, insertLength);
 	style.InsertValue(position, insertLength, 0);
 
+	const int linesBefore = Lines();
 	int lineInsert = lv.LineFromPosition(position) + 1;
 	bool atLineStart = lv.LineStart(lineInsert-1) == position;
 	// Point all the lines after the insertion point further along in the buffer
@@ -695,16 +905,44 @@ void CellBuffer::BasicInsertString(int position, const char *s, int insertLength
 			chPrev = chAt;
 		}
 	}
+
+	if (lv.LineCharacterIndex() != SC_LINECHARACTERINDEX_NONE) {
+		const int line = lv.LineFromPosition(position);
+		CountWidths widths;
+		// Text inside one line that can't join with the characters around it just adds
+		// its own width, otherwise the changed lines are counted again
+		if ((Lines() == linesBefore) && !breakingUTF8LineEnd && !ContainsLineEnd(s, insertLength) &&
+			!UTF8IsTrailByte(chAfter) && !UTF8IsTrailByte(static_cast<unsigned char>(s[0])) &&
+			CountCharacterWidths(position, insertLength, widths)) {
+			lv.InsertCharacters(line, widths);
+		} else {
+			RecalculateIndexLineStarts(line - 1, lv.LineFromPosition(position + insertLength) + 1);
+		}
+	}
 }
 
 void CellBuffer::BasicDeleteChars(int position, int deleteLength) {
 	if (deleteLength == 0)
 		return;
 
+	const bool indexed = lv.LineCharacterIndex() != SC_LINECHARACTERINDEX_NONE;
+	const int linesBefore = Lines();
+	bool simpleDelete = false;
+	CountWidths widths;
+	if (indexed) {
+		// Like insertion, removing text inside one line just removes its width
+		const unsigned char chAfter = substance.ValueAt(position + deleteLength);
+		simpleDelete = (lv.LineFromPosition(position) == lv.LineFromPosition(position + deleteLength)) &&
+			!UTF8IsTrailByte(chAfter) &&
+			!UTF8IsTrailByte(static_cast<unsigned char>(substance.ValueAt(position))) &&
+			CountCharacterWidths(position, deleteLength, widths);
+	}
+
 	if ((position == 0) && (deleteLength == substance.Length())) {
 		// If whole buffer is being deleted, faster to reinitialise lines data
 		// than to delete each line.
 		lv.Init();
+		simpleDelete = false;
 	} else {
 		// Have to fix up line positions before doing deletion as looking at text in buffer
 		// to work out which lines have been removed
@@ -763,6 +1001,17 @@ void CellBuffer::BasicDeleteChars(int position, int deleteLength) {
 	}
 	substance.DeleteRange(position, deleteLength);
 	style.DeleteRange(position, deleteLength);
+
+	if (indexed) {
+		const int line = lv.LineFromPosition(position);
+		if (simpleDelete && (Lines() == linesBefore)) {
+			widths.countCharacters = -widths.countCharacters;
+			widths.countUTF16 = -widths.countUTF16;
+			lv.InsertCharacters(line, widths);
+		} else {
+			RecalculateIndexLineStarts(line - 1, line + 1);
+		}
+	}
 }
 
 bool CellBuffer::SetUndoCollection(bool collectUndo) {
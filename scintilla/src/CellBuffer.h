@@ -24,10 +24,41 @@ public:
 /**
  * The line vector contains information about each of the lines in a cell buffer.
  */
+/// Number of characters and of UTF-16 code units in some text.
+struct CountWidths {
+	int countCharacters;
+	int countUTF16;
+	CountWidths() : countCharacters(0), countUTF16(0) {
+	}
+};
+
+/// The character or UTF-16 code unit positions of the line starts, only maintained while
+/// allocated by some client.
+class LineStartIndex {
+	// Private so LineStartIndex objects can not be copied
+	LineStartIndex(const LineStartIndex &);
+	LineStartIndex &operator=(const LineStartIndex &);
+public:
+	int refCount;
+	Partitioning starts;
+
+	LineStartIndex();
+	bool Allocate(int lines);
+	bool Release();
+	bool Active() const {
+		return refCount > 0;
+	}
+	int LineWidth(int line) const;
+	void SetLineWidth(int line, int width);
+	void InsertLines(int line, int lines);
+};
+
 class LineVector {
 
 	Partitioning starts;
 	PerLine *perLine;
+	LineStartIndex startsUTF16;
+	LineStartIndex startsUTF32;
 
 public:
 
@@ -47,6 +78,14 @@ public:
 	int LineStart(int line) const {
 		return starts.PositionFromPartition(line);
 	}
+
+	int LineCharacterIndex() const;
+	bool AllocateLineCharacterIndex(int lineCharacterIndex, int lines);
+	bool ReleaseLineCharacterIndex(int lineCharacterIndex);
+	int IndexLineStart(int line, int lineCharacterIndex) const;
+	int LineFromPositionIndex(int pos, int lineCharacterIndex) const;
+	void SetLineCharactersWidth(int line, const CountWidths &width);
+	void InsertCharacters(int line, const CountWidths &delta);
 };
 
 enum actionType { insertAction, removeAction, startAction, containerAction };
@@ -130,6 +169,7 @@ private:
 	SplitVector<char> substance;
 	SplitVector<char> style;
 	bool readOnly;
+	bool utf8Substance;
 	int utf8LineEnds;
 
 	bool collectingUndo;
@@ -139,6 +179,8 @@ private:
 
 	bool UTF8LineEndOverlaps(int position) const;
 	void ResetLineEnds();
+	bool CountCharacterWidths(int position, int length, CountWidths &widths) const;
+	void RecalculateIndexLineStarts(int lineFirst, int lineLast);
 	/// Actions without undo
 	void BasicInsertString(int position, const char *s, int insertLength);
 	void BasicDeleteChars(int position, int deleteLength);
@@ -159,6 +201,7 @@ public:
 
 	int Length() const;
 	void Allocate(int newSize);
+	void SetUTF8Substance(bool utf8Substance_);
 	int GetLineEndTypes() const { return utf8LineEnds; }
 	void SetLineEndTypes(int utf8LineEnds_);
 	bool ContainsLineEnd(const char *s, int length) const;
@@ -168,6 +211,11 @@ public:
 	int LineFromPosition(int pos) const { return lv.LineFromPosition(pos); }
 	void InsertLine(int line, int position, bool lineStart);
 	void RemoveLine(int line);
+	int LineCharacterIndex() const;
+	void AllocateLineCharacterIndex(int lineCharacterIndex);
+	void ReleaseLineCharacterIndex(int lineCharacterIndex);
+	int IndexLineStart(int line, int lineCharacterIndex) const;
+	int LineFromPositionIndex(int pos, int lineCharacterIndex) const;
 	const char *InsertString(int position, const char *s, int insertLength, bool &startSequence);
 
 	/// Setting styles for positions outside the range of the buffer is safe and has no effect.
@@ -338,6 +338,12 @@ public:
 	const char *RangePointer(int position, int rangeLength) { return cb.RangePointer(position, rangeLength); }
 	int GapPosition() const { return cb.GapPosition(); }
 
+	int LineCharacterIndex() const { return cb.LineCharacterIndex(); }
+	void AllocateLineCharacterIndex(int lineCharacterIndex) { cb.AllocateLineCharacterIndex(lineCharacterIndex); }
+	void ReleaseLineCharacterIndex(int lineCharacterIndex) { cb.ReleaseLineCharacterIndex(lineCharacterIndex); }
+	int IndexLineStart(int line, int lineCharacterIndex) const { return cb.IndexLineStart(line, lineCharacterIndex); }
+	int LineFromPositionIndex(int pos, int lineCharacterIndex) const { return cb.LineFromPositionIndex(pos, lineCharacterIndex); }
+
 	int SCI_METHOD GetLineIndentation(Sci_Position line);
 	int SetLineIndentation(int line, int indent);
 	int GetLineIndentPosition(int line) const;
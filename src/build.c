@@ -108,6 +108,10 @@ static struct
 }
 widgets;
 
+/* UTF-8 file names from the error messages of the current build -> locale real
+ * paths, or NULL if not on disk. Builds tend to report many errors per file. */
+static GHashTable *error_real_paths = NULL;
+
 static guint build_groups_count[GEANY_GBG_COUNT] = { 3, 4, 2 };
 static guint build_items_count = 9;
 
@@ -130,6 +134,8 @@ static void on_build_menu_item(GtkWidget *w, gpointer user_data);
 
 void build_finalize(void)
 {
+	if (error_real_paths)
+		g_hash_table_destroy(error_real_paths);
 	g_free(build_info.dir);
 	g_free(build_info.custom_target);
 
@@ -741,11 +747,15 @@ static void build_spawn_cmd(GeanyDocument *doc, const gchar *cmd, const gchar *d
 
 	clear_all_errors();
 	SETPTR(current_dir_entered, NULL);
+	if (error_real_paths)
+		g_hash_table_remove_all(error_real_paths);
+	else
+		error_real_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
 
 	utf8_working_dir = !EMPTY(dir) ? g_strdup(dir) : g_path_get_dirname(doc->file_name);
 	working_dir = utils_get_locale_from_utf8(utf8_working_dir);
 
-	gtk_list_store_clear(msgwindow.store_compiler);
+	msgwin_clear_tab(MSG_COMPILER);
 	gtk_notebook_set_current_page(GTK_NOTEBOOK(msgwindow.notebook), MSG_COMPILER);
 	msgwin_compiler_add(COLOR_BLUE, _("%s (in directory: %s)"), cmd, utf8_working_dir);
 	g_free(utf8_working_dir);
@@ -967,7 +977,7 @@ static void process_build_output_line(gchar *msg, gint color)
 
 	if (line != -1 && filename != NULL)
 	{
-		GeanyDocument *doc = document_find_by_filename(filename);
+		GeanyDocument *doc = document_find_by_filename_full(filename, error_real_paths);
 
 		/* limit number of indicators */
 		if (doc && editor_prefs.use_indicators &&
@@ -1417,6 +1427,7 @@ void build_menu_update(GeanyDocument *doc)
 		doc = document_get_current();
 	have_path = doc != NULL && doc->file_name != NULL;
 	build_running =  build_info.pid > (GPid) 1;
+	msgwin_flush();
 	have_errors = gtk_tree_model_iter_n_children(GTK_TREE_MODEL(msgwindow.store_compiler), NULL) > 0;
 	for (i = 0; build_menu_specs[i].build_grp != MENU_DONE; ++i)
 	{
@@ -1625,6 +1636,7 @@ static void kill_process(GPid *pid)
 
 static void on_build_next_error(GtkWidget *menuitem, gpointer user_data)
 {
+	msgwin_flush();
 	if (ui_tree_view_find_next(GTK_TREE_VIEW(msgwindow.tree_compiler),
 		msgwin_goto_compiler_file_line))
 	{
@@ -1637,6 +1649,7 @@ static void on_build_next_error(GtkWidget *menuitem, gpointer user_data)
 
 static void on_build_previous_error(GtkWidget *menuitem, gpointer user_data)
 {
+	msgwin_flush();
 	if (ui_tree_view_find_previous(GTK_TREE_VIEW(msgwindow.tree_compiler),
 		msgwin_goto_compiler_file_line))
 	{
@@ -456,6 +456,9 @@ static void on_notebook1_switch_page_after(GtkNotebook *notebook, gpointer page,
 
 	if (doc != NULL)
 	{
+		/* load the contents of a lazily restored session file */
+		document_ensure_loaded(doc);
+
 		sidebar_select_openfiles_item(doc);
 		ui_save_buttons_toggle(doc->changed);
 		ui_set_window_title(doc);
@@ -1313,6 +1316,7 @@ void on_menu_decrease_indent1_activate(GtkMenuItem *menuitem, gpointer user_data
 
 void on_next_message1_activate(GtkMenuItem *menuitem, gpointer user_data)
 {
+	msgwin_flush();
 	if (! ui_tree_view_find_next(GTK_TREE_VIEW(msgwindow.tree_msg),
 		msgwin_goto_messages_file_line))
 		ui_set_statusbar(FALSE, _("No more message items."));
@@ -1321,6 +1325,7 @@ void on_next_message1_activate(GtkMenuItem *menuitem, gpointer user_data)
 
 void on_previous_message1_activate(GtkMenuItem *menuitem, gpointer user_data)
 {
+	msgwin_flush();
 	if (! ui_tree_view_find_previous(GTK_TREE_VIEW(msgwindow.tree_msg),
 		msgwin_goto_messages_file_line))
 		ui_set_statusbar(FALSE, _("No more message items."));
@@ -1442,7 +1447,7 @@ void on_remove_markers1_activate(GtkMenuItem *menuitem, gpointer user_data)
 
 	sci_marker_delete_all(doc->editor->sci, 0);	/* delete the yellow tag marker */
 	sci_marker_delete_all(doc->editor->sci, 1);	/* delete user markers */
-	editor_indicator_clear(doc->editor, GEANY_INDICATOR_SEARCH);
+	search_mark_all(doc, NULL, 0, NULL);
 }
 
 
@@ -1677,6 +1682,7 @@ static void on_search1_activate(GtkMenuItem *menuitem, gpointer user_data)
 	gboolean have_messages;
 
 	/* enable commands if the messages window has any items */
+	msgwin_flush();
 	have_messages = gtk_tree_model_iter_n_children(GTK_TREE_MODEL(msgwindow.store_msg),
 		NULL) > 0;
 
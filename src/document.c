@@ -88,6 +88,18 @@
 GeanyFilePrefs file_prefs;
 GPtrArray *documents_array = NULL;
 
+/* Indexes of the documents for the document_find_by_*() functions. Entries can be stale
+ * when a document is closed or a plugin changes a field directly, so lookups check
+ * the document found. */
+static struct
+{
+	GHashTable *file_names;		/* file name key -> GSList of GeanyDocument */
+	GHashTable *real_paths;		/* file name key -> GSList of GeanyDocument */
+	GHashTable *scis;			/* ScintillaObject -> GeanyDocument */
+	GHashTable *ids;			/* id -> GeanyDocument */
+}
+doc_index;
+
 
 /* an undo action, also used for redo actions */
 typedef struct
@@ -122,6 +134,144 @@ static GtkWidget* document_show_message(GeanyDocument *doc, GtkMessageType msgty
 	const gchar *extra_text, const gchar *format, ...) G_GNUC_PRINTF(11, 12);
 
 
+/* Gets the key of a file name in the indexes, keys match like utils_filenamecmp() */
+static gchar *get_file_name_key(const gchar *file_name)
+{
+#ifdef G_OS_WIN32
+	gchar *key = g_utf8_strdown(file_name, -1);
+
+	return key ? key : g_strdup(file_name);
+#else
+	return g_strdup(file_name);
+#endif
+}
+
+
+static gint compare_doc_index(gconstpointer a, gconstpointer b)
+{
+	const GeanyDocument *doc_a = a;
+	const GeanyDocument *doc_b = b;
+
+	return (gint) doc_a->index - (gint) doc_b->index;
+}
+
+
+/* Returns the first valid document in documents_array order whose file name
+ * (or real path if real_path is set) matches file_name */
+static GeanyDocument *lookup_file_name(GHashTable *table, const gchar *file_name,
+		gboolean real_path)
+{
+	gchar *key = get_file_name_key(file_name);
+	GSList *node;
+
+	for (node = g_hash_table_lookup(table, key); node != NULL; node = node->next)
+	{
+		GeanyDocument *doc = node->data;
+		const gchar *name = real_path ? doc->real_path : doc->file_name;
+
+		if (doc->is_valid && name != NULL && utils_filenamecmp(file_name, name) == 0)
+		{
+			g_free(key);
+			return doc;
+		}
+	}
+	g_free(key);
+	return NULL;
+}
+
+
+/* Replaces the document list of key, taking ownership of key */
+static void set_file_name_docs(GHashTable *table, gchar *key, GSList *docs)
+{
+	gpointer orig_key;
+
+	/* steal the old entry so its list isn't freed along with it */
+	if (g_hash_table_lookup_extended(table, key, &orig_key, NULL))
+	{
+		g_hash_table_steal(table, key);
+		g_free(orig_key);
+	}
+	if (docs != NULL)
+		g_hash_table_insert(table, key, docs);
+	else
+		g_free(key);
+}
+
+
+/* Several documents can share a file name or real path, so each key maps to a list
+ * of documents sorted by their index */
+static void index_file_name(GHashTable *table, const gchar *file_name, GeanyDocument *doc)
+{
+	gchar *key;
+	GSList *docs;
+
+	if (file_name == NULL)
+		return;
+
+	key = get_file_name_key(file_name);
+	docs = g_hash_table_lookup(table, key);
+	if (g_slist_find(docs, doc) == NULL)
+		set_file_name_docs(table, key, g_slist_insert_sorted(docs, doc, compare_doc_index));
+	else
+		g_free(key);
+}
+
+
+static void unindex_file_name(GHashTable *table, const gchar *file_name, GeanyDocument *doc)
+{
+	gchar *key;
+	GSList *docs;
+
+	if (file_name == NULL)
+		return;
+
+	key = get_file_name_key(file_name);
+	docs = g_hash_table_lookup(table, key);
+	if (g_slist_find(docs, doc) != NULL)
+		set_file_name_docs(table, key, g_slist_remove(docs, doc));
+	else
+		g_free(key);
+}
+
+
+/* Sets doc->file_name, taking ownership of utf8_filename */
+static void set_file_name(GeanyDocument *doc, gchar *utf8_filename)
+{
+	unindex_file_name(doc_index.file_names, doc->file_name, doc);
+	SETPTR(doc->file_name, utf8_filename);
+	index_file_name(doc_index.file_names, doc->file_name, doc);
+}
+
+
+/* Sets doc->real_path, taking ownership of real_path */
+static void set_real_path(GeanyDocument *doc, gchar *real_path)
+{
+	unindex_file_name(doc_index.real_paths, doc->real_path, doc);
+	SETPTR(doc->real_path, real_path);
+	index_file_name(doc_index.real_paths, doc->real_path, doc);
+}
+
+
+static void index_document(GeanyDocument *doc)
+{
+	index_file_name(doc_index.file_names, doc->file_name, doc);
+	index_file_name(doc_index.real_paths, doc->real_path, doc);
+	g_hash_table_insert(doc_index.scis, doc->editor->sci, doc);
+	g_hash_table_insert(doc_index.ids, GUINT_TO_POINTER(doc->id), doc);
+}
+
+
+static void unindex_document(GeanyDocument *doc)
+{
+	unindex_file_name(doc_index.file_names, doc->file_name, doc);
+	unindex_file_name(doc_index.real_paths, doc->real_path, doc);
+	if (g_hash_table_lookup(doc_index.scis, doc->editor->sci) == doc)
+		g_hash_table_remove(doc_index.scis, doc->editor->sci);
+	if (g_hash_table_lookup(doc_index.ids, GUINT_TO_POINTER(doc->id)) == doc)
+		g_hash_table_remove(doc_index.ids, GUINT_TO_POINTER(doc->id));
+}
+
+
 /**
  * Finds a document whose @c real_path field matches the given filename.
  *
@@ -138,24 +288,10 @@ static GtkWidget* document_show_message(GeanyDocument *doc, GtkMessageType msgty
 GEANY_API_SYMBOL
 GeanyDocument* document_find_by_real_path(const gchar *realname)
 {
-	guint i;
-
 	if (! realname)
 		return NULL;	/* file doesn't exist on disk */
 
-	for (i = 0; i < documents_array->len; i++)
-	{
-		GeanyDocument *doc = documents[i];
-
-		if (! doc->is_valid || ! doc->real_path)
-			continue;
-
-		if (utils_filenamecmp(realname, doc->real_path) == 0)
-		{
-			return doc;
-		}
-	}
-	return NULL;
+	return lookup_file_name(doc_index.real_paths, realname, TRUE);
 }
 
 
@@ -184,7 +320,15 @@ static gchar *get_real_path_from_utf8(const gchar *utf8_filename)
 GEANY_API_SYMBOL
 GeanyDocument *document_find_by_filename(const gchar *utf8_filename)
 {
-	guint i;
+	return document_find_by_filename_full(utf8_filename, NULL);
+}
+
+
+/* Like document_find_by_filename(), but if real_paths is set the real paths are looked up
+ * in it and added to it, as resolving them is slow when many names are looked up.
+ * real_paths maps UTF-8 file names to locale real paths, or NULL if not on disk. */
+GeanyDocument *document_find_by_filename_full(const gchar *utf8_filename, GHashTable *real_paths)
+{
 	GeanyDocument *doc;
 	gchar *realname;
 
@@ -192,38 +336,37 @@ GeanyDocument *document_find_by_filename(const gchar *utf8_filename)
 
 	/* First search GeanyDocument::file_name, so we can find documents with a
 	 * filename set but not saved on disk, like vcdiff produces */
-	for (i = 0; i < documents_array->len; i++)
-	{
-		doc = documents[i];
-
-		if (! doc->is_valid || doc->file_name == NULL)
-			continue;
+	doc = lookup_file_name(doc_index.file_names, utf8_filename, FALSE);
+	if (doc != NULL)
+		return doc;
 
-		if (utils_filenamecmp(utf8_filename, doc->file_name) == 0)
-		{
-			return doc;
-		}
-	}
 	/* Now try matching based on the realpath(), which is unique per file on disk */
-	realname = get_real_path_from_utf8(utf8_filename);
-	doc = document_find_by_real_path(realname);
-	g_free(realname);
-	return doc;
+	if (! real_paths)
+	{
+		realname = get_real_path_from_utf8(utf8_filename);
+		doc = document_find_by_real_path(realname);
+		g_free(realname);
+		return doc;
+	}
+	if (! g_hash_table_lookup_extended(real_paths, utf8_filename, NULL, (gpointer *) &realname))
+	{
+		realname = get_real_path_from_utf8(utf8_filename);
+		g_hash_table_insert(real_paths, g_strdup(utf8_filename), realname);
+	}
+	return document_find_by_real_path(realname);
 }
 
 
 /* returns the document which has sci, or NULL. */
 GeanyDocument *document_find_by_sci(ScintillaObject *sci)
 {
-	guint i;
+	GeanyDocument *doc;
 
 	g_return_val_if_fail(sci != NULL, NULL);
 
-	for (i = 0; i < documents_array->len; i++)
-	{
-		if (documents[i]->is_valid && documents[i]->editor->sci == sci)
-			return documents[i];
-	}
+	doc = g_hash_table_lookup(doc_index.scis, sci);
+	if (doc && doc->is_valid && doc->editor->sci == sci)
+		return doc;
 	return NULL;
 }
 
@@ -248,16 +391,14 @@ GeanyDocument *document_find_by_sci(ScintillaObject *sci)
 GEANY_API_SYMBOL
 GeanyDocument *document_find_by_id(guint id)
 {
-	guint i;
+	GeanyDocument *doc;
 
 	if (!id)
 		return NULL;
 
-	foreach_document(i)
-	{
-		if (documents[i]->id == id)
-			return documents[i];
-	}
+	doc = g_hash_table_lookup(doc_index.ids, GUINT_TO_POINTER(id));
+	if (doc && doc->is_valid && doc->id == id)
+		return doc;
 	return NULL;
 }
 
@@ -384,6 +525,12 @@ GeanyDocument *document_get_current(void)
 void document_init_doclist(void)
 {
 	documents_array = g_ptr_array_new();
+	doc_index.file_names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+		(GDestroyNotify) g_slist_free);
+	doc_index.real_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+		(GDestroyNotify) g_slist_free);
+	doc_index.scis = g_hash_table_new(g_direct_hash, g_direct_equal);
+	doc_index.ids = g_hash_table_new(g_direct_hash, g_direct_equal);
 }
 
 
@@ -394,6 +541,10 @@ void document_finalize(void)
 	for (i = 0; i < documents_array->len; i++)
 		g_free(documents[i]);
 	g_ptr_array_free(documents_array, TRUE);
+	g_hash_table_destroy(doc_index.file_names);
+	g_hash_table_destroy(doc_index.real_paths);
+	g_hash_table_destroy(doc_index.scis);
+	g_hash_table_destroy(doc_index.ids);
 }
 
 
@@ -653,6 +804,7 @@ static GeanyDocument *document_create(const gchar *utf8_filename)
 	doc->index = new_idx;
 	doc->file_name = g_strdup(utf8_filename);
 	doc->editor = editor_create(doc);
+	index_document(doc);
 #ifndef USE_GIO_FILEMON
 	doc->priv->last_check = time(NULL);
 #endif
@@ -716,6 +868,7 @@ static gboolean remove_page(guint page_num)
 
 	g_datalist_clear(&doc->priv->data);
 
+	unindex_document(doc);
 	doc->is_valid = FALSE;
 	doc->id = 0;
 
@@ -735,6 +888,7 @@ static gboolean remove_page(guint page_num)
 	}
 	g_free(doc->encoding);
 	g_free(doc->priv->saved_encoding.encoding);
+	g_free(doc->priv->lazy_forced_enc);
 	g_free(doc->file_name);
 	g_free(doc->real_path);
 	if (doc->tm_file)
@@ -746,6 +900,8 @@ static gboolean remove_page(guint page_num)
 	if (doc->priv->tag_tree)
 		gtk_widget_destroy(doc->priv->tag_tree);
 
+	search_mark_all_stop(doc);
+	word_index_free(doc->priv->word_index);
 	editor_destroy(doc->editor);
 	doc->editor = NULL; /* needs to be NULL for document_undo_clear() call below */
 
@@ -913,10 +1069,19 @@ GeanyDocument *document_open_file(const gchar *locale_filename, gboolean readonl
 }
 
 
+/* files at least this big are read straight into Scintilla instead of into memory
+ * first, if they don't need to be converted */
+#define LARGE_FILE_SIZE (32 * 1024 * 1024)
+/* how much of a large file is read at once, between progress updates */
+#define LARGE_FILE_CHUNK_SIZE (4 * 1024 * 1024)
+
+
 typedef struct
 {
-	gchar		*data;	/* null-terminated file data */
-	gsize		 len;	/* string length of data */
+	gchar		*data;	/* null-terminated file data, NULL for a large file */
+	gsize		 len;	/* string length of data, or of the text of a large file */
+	gchar		*large_file;	/* locale name of a large file read when setting the text */
+	gsize		 text_offset;	/* where the text of a large file starts, after a BOM */
 	gchar		*enc;
 	gboolean	 bom;
 	time_t		 mtime;	/* modification time, read by stat::st_mtime */
@@ -924,6 +1089,87 @@ typedef struct
 } FileData;
 
 
+static void file_data_free_contents(FileData *filedata)
+{
+	g_free(filedata->data);
+	g_free(filedata->large_file);
+	filedata->data = NULL;
+	filedata->large_file = NULL;
+}
+
+
+/* Sets the text of sci to the file contents. Large files are read in chunks to
+ * show the progress, avoiding a copy of the whole file on the way. A large file
+ * that changed since it was checked is read as it is now, a read error just
+ * stops reading. */
+static void file_data_set_text(FileData *filedata, ScintillaObject *sci)
+{
+	GtkProgressBar *bar = GTK_PROGRESS_BAR(main_widgets.progressbar);
+	gboolean show_progress;
+	gsize pos = 0, chunk;
+	gchar *buf;
+	FILE *fp;
+
+	if (! filedata->large_file)
+	{
+		sci_set_text(sci, filedata->data);	/* NULL terminated data */
+		return;
+	}
+
+	/* don't take over the progress bar if something else uses it */
+	show_progress = main_status.main_window_realized && interface_prefs.statusbar_visible &&
+		! gtk_widget_get_visible(GTK_WIDGET(bar));
+	if (show_progress)
+	{
+		gtk_progress_bar_set_text(bar, _("Loading file"));
+		gtk_progress_bar_set_fraction(bar, 0.0);
+		gtk_widget_show(GTK_WIDGET(bar));
+	}
+
+	/* group the changes like SCI_SETTEXT does */
+	sci_start_undo_action(sci);
+	sci_clear_all(sci);
+	scintilla_send_message(sci, SCI_ALLOCATE, (uptr_t) filedata->len + 1, 0);
+	fp = g_fopen(filedata->large_file, "rb");
+	if (fp != NULL && fseek(fp, (long) filedata->text_offset, SEEK_SET) == 0)
+	{
+		buf = g_malloc(LARGE_FILE_CHUNK_SIZE);
+		while ((chunk = fread(buf, 1, LARGE_FILE_CHUNK_SIZE, fp)) > 0)
+		{
+			scintilla_send_message(sci, SCI_APPENDTEXT, (uptr_t) chunk, (sptr_t) buf);
+			pos += chunk;
+
+			if (show_progress)
+			{
+				gtk_progress_bar_set_fraction(bar, MIN(pos / (gdouble) filedata->len, 1.0));
+				/* only repaint, handling events might close the document being loaded */
+				gdk_window_process_updates(gtk_widget_get_window(GTK_WIDGET(bar)), FALSE);
+			}
+		}
+		g_free(buf);
+	}
+	if (fp != NULL)
+		fclose(fp);
+	sci_end_undo_action(sci);
+
+	if (show_progress)
+		gtk_widget_hide(GTK_WIDGET(bar));
+}
+
+
+/* Detects the line endings of the file contents, after file_data_set_text() for
+ * large files */
+static gint file_data_get_line_endings(FileData *filedata, ScintillaObject *sci)
+{
+	if (! filedata->large_file)
+		return utils_get_line_endings(filedata->data, filedata->len);
+
+	return utils_get_line_endings(
+		(const gchar *) scintilla_send_message(sci, SCI_GETCHARACTERPOINTER, 0, 0),
+		(gsize) sci_get_length(sci));
+}
+
+
 static gboolean get_mtime(const gchar *locale_filename, time_t *time)
 {
 	GError *error = NULL;
@@ -973,21 +1219,231 @@ static gboolean get_mtime(const gchar *locale_filename, time_t *time)
 }
 
 
-/* loads textfile data, verifies and converts to forced_enc or UTF-8. Also handles BOM. */
-static gboolean load_text_file(const gchar *locale_filename, const gchar *display_filename,
-	FileData *filedata, const gchar *forced_enc)
+/* A file read and converted to UTF-8 in the background, see document_prefetch_file() */
+typedef struct
 {
-	GError *err = NULL;
+	gchar		*locale_filename;
+	gchar		*forced_enc;
+	FileData	 filedata;
+	gboolean	 loaded;	/* whether filedata is valid */
+	gboolean	 done;		/* protected by prefetch_mutex */
+} PrefetchData;
 
-	filedata->data = NULL;
-	filedata->len = 0;
-	filedata->enc = NULL;
-	filedata->bom = FALSE;
-	filedata->readonly = FALSE;
+static GThreadPool *prefetch_pool = NULL;
+static GHashTable *prefetched_files = NULL;	/* locale filename -> PrefetchData, main thread only */
+static GMutex prefetch_mutex;
+static GCond prefetch_cond;
 
-	if (!get_mtime(locale_filename, &filedata->mtime))
+
+static void prefetch_data_free(PrefetchData *pd)
+{
+	g_free(pd->filedata.data);
+	g_free(pd->filedata.enc);
+	g_free(pd->locale_filename);
+	g_free(pd->forced_enc);
+	g_slice_free(PrefetchData, pd);
+}
+
+
+/* runs in a prefetch worker thread, so it mustn't touch the UI */
+static void prefetch_file_thread(gpointer data, gpointer pool_data)
+{
+	PrefetchData *pd = data;
+	FileData *filedata = &pd->filedata;
+	GStatBuf st;
+	gboolean loaded = FALSE;
+
+	/* large files are read straight into Scintilla when opened instead */
+	if (g_stat(pd->locale_filename, &st) == 0 && st.st_size < LARGE_FILE_SIZE &&
+		g_file_get_contents(pd->locale_filename, &filedata->data, &filedata->len, NULL))
+	{
+		filedata->mtime = st.st_mtime;
+		loaded = encodings_convert_to_utf8_auto(&filedata->data, &filedata->len, pd->forced_enc,
+			&filedata->enc, &filedata->bom, &filedata->readonly);
+		if (! loaded)
+			SETPTR(filedata->data, NULL);
+	}
+
+	g_mutex_lock(&prefetch_mutex);
+	pd->loaded = loaded;
+	pd->done = TRUE;
+	g_cond_broadcast(&prefetch_cond);
+	g_mutex_unlock(&prefetch_mutex);
+}
+
+
+/* Starts reading and decoding a file in the background, so that a following
+ * document_open_file_full() for the same file and encoding only has to wait for
+ * the result instead of doing the work itself. Files are processed in the order
+ * they are queued. document_prefetch_finish() must be called when done opening. */
+void document_prefetch_file(const gchar *locale_filename, const gchar *forced_enc)
+{
+	PrefetchData *pd;
+
+	g_return_if_fail(locale_filename != NULL);
+
+	if (prefetch_pool == NULL)
+	{
+		prefetch_pool = g_thread_pool_new(prefetch_file_thread, NULL,
+			MAX(utils_get_num_processors(), 2), FALSE, NULL);
+		prefetched_files = g_hash_table_new(g_str_hash, g_str_equal);
+	}
+
+	pd = g_slice_new0(PrefetchData);
+	pd->locale_filename = g_strdup(locale_filename);
+	/* use the same name document_open_file_full() passes to load_text_file() */
+	utils_tidy_path(pd->locale_filename);
+	pd->forced_enc = g_strdup(forced_enc);
+
+	if (g_hash_table_lookup(prefetched_files, pd->locale_filename))
+	{
+		prefetch_data_free(pd);
+		return;
+	}
+	g_hash_table_insert(prefetched_files, pd->locale_filename, pd);
+	g_thread_pool_push(prefetch_pool, pd, NULL);
+}
+
+
+/* Drops prefetched data which wasn't used, e.g. because the file was already open */
+void document_prefetch_finish(void)
+{
+	GHashTableIter iter;
+	gpointer pd;
+
+	if (prefetch_pool == NULL)
+		return;
+
+	/* skip files not yet started and wait for the running ones */
+	g_thread_pool_free(prefetch_pool, TRUE, TRUE);
+	prefetch_pool = NULL;
+
+	g_hash_table_iter_init(&iter, prefetched_files);
+	while (g_hash_table_iter_next(&iter, NULL, &pd))
+		prefetch_data_free(pd);
+	g_hash_table_destroy(prefetched_files);
+	prefetched_files = NULL;
+}
+
+
+/* Takes the prefetched data for locale_filename if it matches the requested
+ * encoding and filedata->mtime, waiting for the prefetch to finish if needed. */
+static gboolean take_prefetched_file(const gchar *locale_filename, const gchar *forced_enc,
+		FileData *filedata)
+{
+	PrefetchData *pd;
+	gboolean ret = FALSE;
+
+	if (prefetched_files == NULL)
+		return FALSE;
+	pd = g_hash_table_lookup(prefetched_files, locale_filename);
+	if (pd == NULL)
+		return FALSE;
+	g_hash_table_steal(prefetched_files, locale_filename);
+
+	g_mutex_lock(&prefetch_mutex);
+	while (! pd->done)
+		g_cond_wait(&prefetch_cond, &prefetch_mutex);
+	g_mutex_unlock(&prefetch_mutex);
+
+	if (pd->loaded && utils_str_equal(pd->forced_enc, forced_enc) &&
+		pd->filedata.mtime == filedata->mtime)
+	{
+		filedata->data = pd->filedata.data;
+		filedata->len = pd->filedata.len;
+		filedata->enc = pd->filedata.enc;
+		filedata->bom = pd->filedata.bom;
+		filedata->readonly = pd->filedata.readonly;
+		pd->filedata.data = NULL;
+		pd->filedata.enc = NULL;
+		ret = TRUE;
+	}
+	prefetch_data_free(pd);
+
+	return ret;
+}
+
+
+/* Checks whether a large file can be used as is without converting it, so it can be
+ * read straight into Scintilla by file_data_set_text() and only Scintilla holds a
+ * copy of the data. The file is checked in chunks. Returns FALSE if the file has
+ * to be read into memory. */
+static gboolean check_large_text_file(const gchar *locale_filename, FileData *filedata,
+	const gchar *forced_enc)
+{
+	GStatBuf st;
+	FILE *fp;
+	gchar *buf;
+	gsize len = 0, total = 0;
+	guint bom_len = 0;
+	gboolean valid = TRUE, first = TRUE, eof = FALSE;
+
+	/* Scintilla can't hold more than G_MAXINT bytes */
+	if (g_stat(locale_filename, &st) != 0 ||
+		st.st_size < LARGE_FILE_SIZE || st.st_size >= G_MAXINT)
+		return FALSE;
+
+	fp = g_fopen(locale_filename, "rb");
+	if (fp == NULL)
+		return FALSE;
+
+	buf = g_malloc(LARGE_FILE_CHUNK_SIZE);
+	while (valid && ! eof)
+	{
+		gsize n = fread(buf + len, 1, LARGE_FILE_CHUNK_SIZE - len, fp);
+		gsize end;
+
+		len += n;
+		total += n;
+		eof = len < LARGE_FILE_CHUNK_SIZE;
+		if (ferror(fp))
+			break;
+
+		/* a character split between chunks is checked with the next chunk */
+		end = len;
+		if (! eof)
+		{
+			end = len - 1;
+			while (end > len - 4 && ((guchar) buf[end] & 0xC0) == 0x80)
+				end--;
+		}
+
+		/* the first chunk holds the BOM and the encoding specified in the data */
+		if (first)
+			valid = encodings_is_utf8_auto(buf, end, forced_enc, &bom_len);
+		else
+			valid = g_utf8_validate(buf, (gssize) end, NULL);
+		first = FALSE;
+
+		memmove(buf, buf + end, len - end);
+		len -= end;
+	}
+	if (ferror(fp) || total < bom_len)
+		valid = FALSE;
+	g_free(buf);
+	fclose(fp);
+
+	if (! valid)
 		return FALSE;
 
+	filedata->large_file = g_strdup(locale_filename);
+	filedata->text_offset = bom_len;
+	filedata->len = total - bom_len;
+	filedata->enc = g_strdup("UTF-8");
+	filedata->bom = bom_len > 0;
+	return TRUE;
+}
+
+
+/* reads the file and converts it to forced_enc or UTF-8, reporting errors in the statusbar */
+static gboolean read_text_file(const gchar *locale_filename, const gchar *display_filename,
+	FileData *filedata, const gchar *forced_enc)
+{
+	GError *err = NULL;
+
+	if (check_large_text_file(locale_filename, filedata, forced_enc))
+		return TRUE;
+
 	if (USE_GIO_FILE_OPERATIONS)
 	{
 		GFile *file = g_file_new_for_path(locale_filename);
@@ -1022,6 +1478,28 @@ static gboolean load_text_file(const gchar *locale_filename, const gchar *displa
 		g_free(filedata->data);
 		return FALSE;
 	}
+	return TRUE;
+}
+
+
+/* loads textfile data, verifies and converts to forced_enc or UTF-8. Also handles BOM. */
+static gboolean load_text_file(const gchar *locale_filename, const gchar *display_filename,
+	FileData *filedata, const gchar *forced_enc)
+{
+	filedata->data = NULL;
+	filedata->len = 0;
+	filedata->large_file = NULL;
+	filedata->text_offset = 0;
+	filedata->enc = NULL;
+	filedata->bom = FALSE;
+	filedata->readonly = FALSE;
+
+	if (!get_mtime(locale_filename, &filedata->mtime))
+		return FALSE;
+
+	if (! take_prefetched_file(locale_filename, forced_enc, filedata) &&
+		! read_text_file(locale_filename, display_filename, filedata, forced_enc))
+		return FALSE;
 
 	if (filedata->readonly)
 	{
@@ -1273,6 +1751,7 @@ void document_apply_indent_settings(GeanyDocument *doc)
 
 void document_show_tab(GeanyDocument *doc)
 {
+	document_ensure_loaded(doc);
 	gtk_notebook_set_current_page(GTK_NOTEBOOK(main_widgets.notebook),
 		document_get_notebook_page(doc));
 }
@@ -1302,6 +1781,8 @@ GeanyDocument *document_open_file_full(GeanyDocument *doc, const gchar *filename
 	{
 		utf8_filename = g_strdup(doc->file_name);
 		locale_filename = utils_get_locale_from_utf8(utf8_filename);
+		/* reloading loads the contents of a lazy document as well */
+		doc->priv->lazy = FALSE;
 	}
 	else
 	{
@@ -1348,7 +1829,7 @@ GeanyDocument *document_open_file_full(GeanyDocument *doc, const gchar *filename
 			g_return_val_if_fail(doc != NULL, NULL); /* really should not happen */
 
 			/* file exists on disk, set real_path */
-			SETPTR(doc->real_path, tm_get_real_path(locale_filename));
+			set_real_path(doc, tm_get_real_path(locale_filename));
 
 			doc->priv->is_remote = utils_is_remote_path(locale_filename);
 			monitor_file_setup(doc);
@@ -1382,11 +1863,11 @@ GeanyDocument *document_open_file_full(GeanyDocument *doc, const gchar *filename
 
 		/* add the text to the ScintillaObject */
 		sci_set_readonly(doc->editor->sci, FALSE);	/* to allow replacing text */
-		sci_set_text(doc->editor->sci, filedata.data);	/* NULL terminated data */
+		file_data_set_text(&filedata, doc->editor->sci);
 		queue_colourise(doc);	/* Ensure the document gets colourised. */
 
 		/* detect & set line endings */
-		editor_mode = utils_get_line_endings(filedata.data, filedata.len);
+		editor_mode = file_data_get_line_endings(&filedata, doc->editor->sci);
 		if (undo_reload_data)
 		{
 			undo_reload_data->eol_mode = editor_get_eol_char_mode(doc->editor);
@@ -1395,7 +1876,7 @@ GeanyDocument *document_open_file_full(GeanyDocument *doc, const gchar *filename
 				add_undo_reload_action = TRUE;
 		}
 		sci_set_eol_mode(doc->editor->sci, editor_mode);
-		g_free(filedata.data);
+		file_data_free_contents(&filedata);
 
 		sci_set_undo_collection(doc->editor->sci, TRUE);
 
@@ -1517,6 +1998,133 @@ GeanyDocument *document_open_file_full(GeanyDocument *doc, const gchar *filename
 }
 
 
+/* Opens a document without loading the file contents, which is done by
+ * document_ensure_loaded() when the tab is shown for the first time. Until then
+ * the tags are parsed from the file on disk. Used to restore big sessions quickly.
+ * filename should be locale encoded and ft must not be NULL as the filetype can't
+ * be detected from the contents.
+ * Returns: doc of the opened file or NULL if an error occurred. */
+GeanyDocument *document_open_file_lazy(const gchar *filename, gint pos,
+		gboolean readonly, GeanyFiletype *ft, const gchar *forced_enc)
+{
+	GeanyDocument *doc;
+	gchar *locale_filename;
+	gchar *utf8_filename;
+	time_t mtime;
+
+	g_return_val_if_fail(filename != NULL, NULL);
+	g_return_val_if_fail(ft != NULL, NULL);
+
+	locale_filename = g_strdup(filename);
+	utils_tidy_path(locale_filename);
+	utf8_filename = utils_get_utf8_from_locale(locale_filename);
+
+	/* if file is already open, or can't be opened, use the normal path to handle it */
+	if (document_find_by_filename(utf8_filename) != NULL || ! get_mtime(locale_filename, &mtime))
+	{
+		g_free(utf8_filename);
+		g_free(locale_filename);
+		return document_open_file_full(NULL, filename, pos, readonly, ft, forced_enc);
+	}
+
+	doc = document_create(utf8_filename);
+	g_return_val_if_fail(doc != NULL, NULL); /* really should not happen */
+
+	set_real_path(doc, tm_get_real_path(locale_filename));
+	doc->priv->is_remote = utils_is_remote_path(locale_filename);
+	monitor_file_setup(doc);
+
+	doc->priv->lazy = TRUE;
+	doc->priv->lazy_pos = pos;
+	doc->priv->lazy_forced_enc = g_strdup(forced_enc);
+	doc->priv->mtime = mtime;
+	doc->encoding = g_strdup(forced_enc != NULL ? forced_enc : encodings[GEANY_ENCODING_UTF_8].charset);
+	store_saved_encoding(doc);
+	doc->readonly = readonly;
+	/* the empty buffer must not be edited */
+	sci_set_readonly(doc->editor->sci, TRUE);
+
+	g_signal_connect(doc->editor->sci, "sci-notify", G_CALLBACK(editor_sci_notify_cb),
+		doc->editor);
+	/* update taglist, typedef keywords and build menu if necessary */
+	document_set_filetype(doc, ft);
+	document_apply_indent_settings(doc);
+
+	document_set_text_changed(doc, FALSE);
+	ui_document_show_hide(doc);
+
+	g_signal_emit_by_name(geany_object, "document-open", doc);
+	gtk_widget_show(document_get_notebook_child(doc));
+
+	g_free(utf8_filename);
+	g_free(locale_filename);
+	return doc;
+}
+
+
+/* Loads the contents of a document opened with document_open_file_lazy(), does
+ * nothing for other documents.
+ * Returns: FALSE if the contents couldn't be loaded. */
+gboolean document_ensure_loaded(GeanyDocument *doc)
+{
+	gchar *locale_filename;
+	gchar *display_filename;
+	FileData filedata;
+	gboolean ret;
+
+	g_return_val_if_fail(DOC_VALID(doc), FALSE);
+
+	if (! doc->priv->lazy)
+		return TRUE;
+	doc->priv->lazy = FALSE;
+
+	locale_filename = utils_get_locale_from_utf8(doc->file_name);
+	display_filename = utils_str_middle_truncate(doc->file_name, 100);
+
+	ret = load_text_file(locale_filename, display_filename, &filedata,
+		doc->priv->lazy_forced_enc);
+	if (ret)
+	{
+		sci_set_readonly(doc->editor->sci, FALSE);
+		sci_set_undo_collection(doc->editor->sci, FALSE); /* avoid creation of an undo action */
+		file_data_set_text(&filedata, doc->editor->sci);
+		sci_set_eol_mode(doc->editor->sci, file_data_get_line_endings(&filedata, doc->editor->sci));
+		sci_set_undo_collection(doc->editor->sci, TRUE);
+		sci_empty_undo_buffer(doc->editor->sci);
+		file_data_free_contents(&filedata);
+
+		doc->priv->mtime = filedata.mtime;
+		SETPTR(doc->encoding, filedata.enc);
+		doc->has_bom = filedata.bom;
+		store_saved_encoding(doc);
+		doc->readonly = doc->readonly || filedata.readonly;
+		sci_set_readonly(doc->editor->sci, doc->readonly);
+
+		doc->priv->line_count = sci_get_line_count(doc->editor->sci);
+		sci_set_line_numbers(doc->editor->sci, editor_prefs.show_linenumber_margin);
+
+		sci_set_current_position(doc->editor->sci, doc->priv->lazy_pos, FALSE);
+		doc->editor->scroll_percent = 0.5F;
+
+		queue_colourise(doc);
+		document_update_tags(doc);
+		document_set_text_changed(doc, FALSE);
+		ui_document_show_hide(doc);
+	}
+	else
+	{
+		/* keep the empty buffer from overwriting the file */
+		doc->readonly = TRUE;
+		ui_update_tab_status(doc);
+	}
+	SETPTR(doc->priv->lazy_forced_enc, NULL);
+
+	g_free(display_filename);
+	g_free(locale_filename);
+	return ret;
+}
+
+
 /* Takes a new line separated list of filename URIs and opens each file.
  * length is the length of the string */
 void document_open_file_list(const gchar *data, gsize length)
@@ -1818,10 +2426,10 @@ gboolean document_save_file_as(GeanyDocument *doc, const gchar *utf8_fname)
 
 	new_file = document_need_save_as(doc) || (utf8_fname != NULL && strcmp(doc->file_name, utf8_fname) != 0);
 	if (utf8_fname != NULL)
-		SETPTR(doc->file_name, g_strdup(utf8_fname));
+		set_file_name(doc, g_strdup(utf8_fname));
 
 	/* reset real path, it's retrieved again in document_save() */
-	SETPTR(doc->real_path, NULL);
+	set_real_path(doc, NULL);
 
 	/* detect filetype */
 	if (doc->file_type->id == GEANY_FILETYPES_NONE)
@@ -1861,18 +2469,20 @@ gboolean document_save_file_as(GeanyDocument *doc, const gchar *utf8_fname)
 }
 
 
-static gsize save_convert_to_encoding(GeanyDocument *doc, gchar **data, gsize *len)
+/* Converts data to the document's encoding. Returns the newly allocated converted
+ * data and sets len to its length, or returns NULL and shows an error */
+static gchar *save_convert_to_encoding(GeanyDocument *doc, const gchar *data, gsize *len)
 {
 	GError *conv_error = NULL;
 	gchar* conv_file_contents = NULL;
 	gsize bytes_read;
 	gsize conv_len;
 
-	g_return_val_if_fail(data != NULL && *data != NULL, FALSE);
-	g_return_val_if_fail(len != NULL, FALSE);
+	g_return_val_if_fail(data != NULL, NULL);
+	g_return_val_if_fail(len != NULL, NULL);
 
 	/* try to convert it from UTF-8 to original encoding */
-	conv_file_contents = g_convert(*data, *len - 1, doc->encoding, "UTF-8",
+	conv_file_contents = g_convert(data, *len - 1, doc->encoding, "UTF-8",
 												&bytes_read, &conv_len, &conv_error);
 
 	if (conv_error != NULL)
@@ -1910,15 +2520,10 @@ _("An error occurred while converting the file from UTF-8 in \"%s\". The file re
 		g_error_free(conv_error);
 		g_free(text);
 		g_free(error_text);
-		return FALSE;
-	}
-	else
-	{
-		g_free(*data);
-		*data = conv_file_contents;
-		*len = conv_len;
+		return NULL;
 	}
-	return TRUE;
+	*len = conv_len;
+	return conv_file_contents;
 }
 
 
@@ -2029,7 +2634,7 @@ static gchar *save_doc(GeanyDocument *doc, const gchar *locale_filename,
 	/* now the file is on disk, set real_path */
 	if (doc->real_path == NULL)
 	{
-		doc->real_path = tm_get_real_path(locale_filename);
+		set_real_path(doc, tm_get_real_path(locale_filename));
 		doc->priv->is_remote = utils_is_remote_path(locale_filename);
 		monitor_file_setup(doc);
 	}
@@ -2100,7 +2705,8 @@ GEANY_API_SYMBOL
 gboolean document_save_file(GeanyDocument *doc, gboolean force)
 {
 	gchar *errmsg;
-	gchar *data;
+	const gchar *data;
+	gchar *buffer = NULL;	/* the data if it isn't Scintilla's buffer */
 	gsize len;
 	gchar *locale_filename;
 	const GeanyFilePrefs *fp;
@@ -2116,6 +2722,8 @@ gboolean document_save_file(GeanyDocument *doc, gboolean force)
 
 	if (!force && !doc->changed)
 		return FALSE;
+	if (! document_ensure_loaded(doc))
+		return FALSE;
 	if (doc->readonly)
 	{
 		ui_set_statusbar(TRUE,
@@ -2148,28 +2756,32 @@ gboolean document_save_file(GeanyDocument *doc, gboolean force)
 	{	/* always write a UTF-8 BOM because in this moment the text itself is still in UTF-8
 		 * encoding, it will be converted to doc->encoding below and this conversion
 		 * also changes the BOM */
-		data = (gchar*) g_malloc(len + 3);	/* 3 chars for BOM */
-		data[0] = (gchar) 0xef;
-		data[1] = (gchar) 0xbb;
-		data[2] = (gchar) 0xbf;
-		sci_get_text(doc->editor->sci, len, data + 3);
+		buffer = (gchar*) g_malloc(len + 3);	/* 3 chars for BOM */
+		buffer[0] = (gchar) 0xef;
+		buffer[1] = (gchar) 0xbb;
+		buffer[2] = (gchar) 0xbf;
+		sci_get_text(doc->editor->sci, len, buffer + 3);
 		len += 3;
+		data = buffer;
 	}
 	else
 	{
-		data = (gchar*) g_malloc(len);
-		sci_get_text(doc->editor->sci, len, data);
+		/* write or convert Scintilla's null-terminated buffer directly instead
+		 * of a copy, it isn't modified until the file is saved */
+		data = (const gchar *) scintilla_send_message(doc->editor->sci,
+			SCI_GETCHARACTERPOINTER, 0, 0);
 	}
 
 	/* save in original encoding, skip when it is already UTF-8 or has the encoding "None" */
 	if (doc->encoding != NULL && ! utils_str_equal(doc->encoding, "UTF-8") &&
 		! utils_str_equal(doc->encoding, encodings[GEANY_ENCODING_NONE].charset))
 	{
-		if (! save_convert_to_encoding(doc, &data, &len))
-		{
-			g_free(data);
+		gchar *converted = save_convert_to_encoding(doc, data, &len);
+
+		g_free(buffer);
+		if (converted == NULL)
 			return FALSE;
-		}
+		data = buffer = converted;
 	}
 	else
 	{
@@ -2183,7 +2795,7 @@ gboolean document_save_file(GeanyDocument *doc, gboolean force)
 
 	/* actually write the content of data to the file on disk */
 	errmsg = save_doc(doc, locale_filename, data, len);
-	g_free(data);
+	g_free(buffer);
 
 	if (errmsg != NULL)
 	{
@@ -2499,7 +3111,9 @@ document_replace_range(GeanyDocument *doc, const gchar *find_text, const gchar *
 	ttf.lpstrText = (gchar*)find_text;
 
 	sci_start_undo_action(sci);
+	editor_bulk_edit_begin(doc->editor, start, end);
 	count = search_replace_range(sci, &ttf, flags, replace_text);
+	editor_bulk_edit_end(doc->editor, start, end, ttf.chrg.cpMax, count > 0);
 	sci_end_undo_action(sci);
 
 	if (count > 0)
@@ -2626,6 +3240,7 @@ gint document_replace_all(GeanyDocument *doc, const gchar *find_text, const gcha
 	if (! *find_text)
 		return FALSE;
 
+	document_ensure_loaded(doc);
 	len = sci_get_length(doc->editor->sci);
 	count = document_replace_range(
 			doc, find_text, replace_text, flags, 0, len, TRUE, NULL);
@@ -2635,16 +3250,27 @@ gint document_replace_all(GeanyDocument *doc, const gchar *find_text, const gcha
 }
 
 
-/*
- * Parses or re-parses the document's buffer and updates the type
- * keywords and symbol list.
- *
- * @param doc The document.
- */
-void document_update_tags(GeanyDocument *doc)
+/* Called from the main loop when the tags parsed in the background are published */
+static void on_document_tags_updated(TMSourceFile *source_file, gboolean changed,
+		gpointer user_data)
+{
+	GeanyDocument *doc = user_data;
+
+	/* the document might have been closed and its structure reused meanwhile */
+	if (! DOC_VALID(doc) || doc->tm_file != source_file)
+		return;
+
+	sidebar_update_tag_list(doc, changed);
+	if (changed)
+		document_highlight_tags(doc);
+}
+
+
+static void update_tags(GeanyDocument *doc, gboolean in_background)
 {
 	guchar *buffer_ptr;
 	gsize len;
+	gboolean new_tm_file = FALSE;
 
 	g_return_if_fail(DOC_VALID(doc));
 	g_return_if_fail(app->tm_workspace != NULL);
@@ -2672,6 +3298,7 @@ void document_update_tags(GeanyDocument *doc)
 
 		if (doc->tm_file)
 			tm_workspace_add_source_file_noupdate(doc->tm_file);
+		new_tm_file = TRUE;
 	}
 
 	/* early out if there's no tm source file and we couldn't create one */
@@ -2684,17 +3311,68 @@ void document_update_tags(GeanyDocument *doc)
 		return;
 	}
 
+	if (doc->priv->lazy)
+	{
+		/* the contents aren't loaded yet, parse the file on disk */
+		tm_workspace_update_source_file(doc->tm_file);
+		sidebar_update_tag_list(doc, TRUE);
+		document_highlight_tags(doc);
+		return;
+	}
+
+	doc->priv->tags_text_version = doc->priv->text_version;
+
 	/* Parse Scintilla's buffer directly using TagManager
 	 * Note: this buffer *MUST NOT* be modified */
 	len = sci_get_length(doc->editor->sci);
 	buffer_ptr = (guchar *) scintilla_send_message(doc->editor->sci, SCI_GETCHARACTERPOINTER, 0, 0);
-	tm_workspace_update_source_file_buffer(doc->tm_file, buffer_ptr, len);
+	/* parse session files in the background too so their tabs open without waiting
+	 * for the parser */
+	if (in_background || main_status.opening_session_files)
+	{
+		/* parse a snapshot of the buffer so typing isn't blocked by the parser,
+		 * the tag list is updated once the new tags are published */
+		if (new_tm_file)
+			sidebar_update_tag_list(doc, TRUE);
+		/* a freshly restored document matches its file, use the tag cache */
+		tm_workspace_update_source_file_buffer_async(doc->tm_file,
+			g_memdup(buffer_ptr, len), len,
+			main_status.opening_session_files && ! doc->changed,
+			on_document_tags_updated, doc);
+		return;
+	}
+	if (! tm_workspace_update_source_file_buffer(doc->tm_file, buffer_ptr, len) && ! new_tm_file)
+	{
+		/* the edit didn't touch any symbol, the tag tree and typenames are still valid */
+		sidebar_update_tag_list(doc, FALSE);
+		return;
+	}
 
 	sidebar_update_tag_list(doc, TRUE);
 	document_highlight_tags(doc);
 }
 
 
+/*
+ * Parses or re-parses the document's buffer and updates the type
+ * keywords and symbol list.
+ *
+ * @param doc The document.
+ */
+void document_update_tags(GeanyDocument *doc)
+{
+	update_tags(doc, FALSE);
+}
+
+
+/* Whether the tags were parsed from the current text, or are being parsed */
+static gboolean tags_up_to_date(GeanyDocument *doc)
+{
+	return doc->tm_file != NULL && ! doc->priv->lazy &&
+		doc->priv->tags_text_version == doc->priv->text_version;
+}
+
+
 /* Re-highlights type keywords without re-parsing the whole document. */
 void document_highlight_tags(GeanyDocument *doc)
 {
@@ -2757,7 +3435,7 @@ static gboolean on_document_update_tag_list_idle(gpointer data)
 		return FALSE;
 
 	if (! main_status.quitting)
-		document_update_tags(doc);
+		update_tags(doc, TRUE);
 
 	doc->priv->tag_list_update_source = 0;
 
@@ -2812,7 +3490,9 @@ static void document_load_config(GeanyDocument *doc, GeanyFiletype *type,
 			doc->priv->symbol_list_sort_mode = type->priv->symbol_list_sort_mode;
 	}
 
-	document_update_tags(doc);
+	/* the filetype is set again after saving, when the tags are usually up to date */
+	if (filetype_changed || ! tags_up_to_date(doc))
+		document_update_tags(doc);
 }
 
 
@@ -3683,7 +4363,7 @@ static void monitor_resave_missing_file(GeanyDocument *doc)
 		protect_document(doc);
 		document_set_text_changed(doc, TRUE);
 		/* don't prompt more than once */
-		SETPTR(doc->real_path, NULL);
+		set_real_path(doc, NULL);
 		doc->priv->info_bars[MSG_TYPE_RESAVE] = bar;
 		enable_key_intercept(doc, bar);
 	}
@@ -3703,9 +4383,10 @@ gboolean document_check_disk_status(GeanyDocument *doc, gboolean force)
 
 	g_return_val_if_fail(doc != NULL, FALSE);
 
-	/* ignore remote files and documents that have never been saved to disk */
+	/* ignore remote files, documents that have never been saved to disk and
+	 * documents whose contents will be loaded later anyway */
 	if (notebook_switch_in_progress() || file_prefs.disk_check_timeout == 0
-			|| doc->real_path == NULL || doc->priv->is_remote)
+			|| doc->real_path == NULL || doc->priv->is_remote || doc->priv->lazy)
 		return FALSE;
 
 	use_gio_filemon = (doc->priv->monitor != NULL);
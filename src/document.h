@@ -67,6 +67,7 @@ typedef struct GeanyFilePrefs
 	gboolean		keep_edit_history_on_reload; /* Keep undo stack upon, and allow undoing of, document reloading. */
 	gboolean		show_keep_edit_history_on_reload_msg; /* whether to show the message introducing the above feature */
  	gboolean		reload_clean_doc_on_file_change;
+	gboolean		lazy_session_tabs;	/* load session files when their tab is first shown */
 }
 GeanyFilePrefs;
 
@@ -246,6 +247,8 @@ void document_reload_config(GeanyDocument *doc);
 
 GeanyDocument *document_find_by_sci(ScintillaObject *sci);
 
+GeanyDocument *document_find_by_filename_full(const gchar *utf8_filename, GHashTable *real_paths);
+
 void document_show_tab(GeanyDocument *doc);
 
 void document_init_doclist(void);
@@ -263,6 +266,15 @@ GeanyDocument *document_open_file_full(GeanyDocument *doc, const gchar *filename
 
 void document_open_file_list(const gchar *data, gsize length);
 
+GeanyDocument *document_open_file_lazy(const gchar *locale_filename, gint pos,
+		gboolean readonly, GeanyFiletype *ft, const gchar *forced_enc);
+
+gboolean document_ensure_loaded(GeanyDocument *doc);
+
+void document_prefetch_file(const gchar *locale_filename, const gchar *forced_enc);
+
+void document_prefetch_finish(void);
+
 gboolean document_search_bar_find(GeanyDocument *doc, const gchar *text, gboolean inc,
 		gboolean backwards);
 
@@ -106,6 +106,10 @@ typedef struct GeanyDocumentPrivate
 	time_t			 mtime;
 	/* ID of the idle callback updating the tag list */
 	guint			 tag_list_update_source;
+	/* Incremented on each change of the text */
+	guint			 text_version;
+	/* text_version of the text the tags were last parsed from */
+	guint			 tags_text_version;
 	/* Whether it's temporarily protected (read-only and saving needs confirmation). Does
 	 * not imply doc->readonly as writable files can be protected */
 	gint			 protected;
@@ -113,6 +117,17 @@ typedef struct GeanyDocumentPrivate
 	GtkWidget		*info_bars[NUM_MSG_TYPES];
 	/* Keyed Data List to attach arbitrary data to the document */
 	GData			*data;
+	/* Whether the file contents are not loaded yet, see document_open_file_lazy() */
+	gboolean		 lazy;
+	/* Cursor position and encoding used when loading the contents of a lazy document */
+	gint			 lazy_pos;
+	gchar			*lazy_forced_enc;
+	/* Mark All search kept up to date with the text, see search_mark_all() */
+	struct MarkAllSearch *mark_all;
+	/* Words of the document for autocompletion, built on first use */
+	struct WordIndex *word_index;
+	/* Whether many edits are being made at once, see editor_bulk_edit_begin() */
+	gboolean		 bulk_edit;
 }
 GeanyDocumentPrivate;
 
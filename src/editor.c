@@ -56,6 +56,7 @@
 #include "templates.h"
 #include "ui_utils.h"
 #include "utils.h"
+#include "wordindex.h"
 
 #include "SciLexer.h"
 
@@ -1123,6 +1124,13 @@ static gboolean on_editor_notify(G_GNUC_UNUSED GObject *object, GeanyEditor *edi
 			break;
 
  		case SCN_MODIFIED:
+			if (doc->priv->bulk_edit)
+			{
+				/* only the start of the undo action is notified, see editor_bulk_edit_begin() */
+				if (nt->modificationType & SC_STARTACTION && ! ignore_callback)
+					document_undo_add(doc, UNDO_SCINTILLA, NULL);
+				break;
+			}
 			if (editor_prefs.show_linenumber_margin && (nt->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)) && nt->linesAdded)
 			{
 				/* automatically adjust Scintilla's line numbers margin width */
@@ -1138,9 +1146,24 @@ static gboolean on_editor_notify(G_GNUC_UNUSED GObject *object, GeanyEditor *edi
 				/* handle special fold cases, e.g. #1923350 */
 				fold_changed(sci, nt->line, nt->foldLevelNow, nt->foldLevelPrev);
 			}
+			if (doc->priv->word_index &&
+				(nt->modificationType & (SC_MOD_BEFOREINSERT | SC_MOD_BEFOREDELETE |
+					SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)))
+			{
+				/* remove the words around the change before it and add them back after it */
+				gboolean before = (nt->modificationType & (SC_MOD_BEFOREINSERT | SC_MOD_BEFOREDELETE)) != 0;
+				gint end = nt->position;
+
+				if (nt->modificationType & (SC_MOD_BEFOREDELETE | SC_MOD_INSERTTEXT))
+					end += nt->length;
+				word_index_update(doc->priv->word_index, sci, nt->position, end, ! before);
+			}
 			if (nt->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT))
 			{
+				doc->priv->text_version++;
 				document_update_tag_list_in_idle(doc);
+				search_mark_all_text_changed(doc, nt->position,
+					(nt->modificationType & SC_MOD_INSERTTEXT) ? nt->length : -nt->length);
 			}
 			break;
 
@@ -2133,57 +2156,23 @@ static gboolean autocomplete_check_html(GeanyEditor *editor, gint style, gint po
 }
 
 
-/* Algorithm based on based on Scite's StartAutoCompleteWord()
- * @returns a sorted list of words matching @p root */
-static GSList *get_doc_words(ScintillaObject *sci, gchar *root, gsize rootlen)
+/* @returns a sorted list of words matching @p root */
+static GSList *get_doc_words(GeanyDocument *doc, gchar *root, gsize rootlen)
 {
+	ScintillaObject *sci = doc->editor->sci;
+	gint current = sci_get_current_position(sci);
 	gchar *word;
-	gint len, current, word_end;
-	gint pos_find, flags;
-	guint word_length;
-	gsize nmatches = 0;
-	GSList *words = NULL;
-	struct Sci_TextToFind ttf;
-
-	len = sci_get_length(sci);
-	current = sci_get_current_position(sci) - rootlen;
-
-	ttf.lpstrText = root;
-	ttf.chrg.cpMin = 0;
-	ttf.chrg.cpMax = len;
-	ttf.chrgText.cpMin = 0;
-	ttf.chrgText.cpMax = 0;
-	flags = SCFIND_WORDSTART | SCFIND_MATCHCASE;
-
-	/* search the whole document for the word root and collect results */
-	pos_find = scintilla_send_message(sci, SCI_FINDTEXT, flags, (uptr_t) &ttf);
-	while (pos_find >= 0 && pos_find < len)
-	{
-		word_end = pos_find + rootlen;
-		if (pos_find != current)
-		{
-			word_end = sci_word_end_position(sci, word_end, TRUE);
+	GSList *words;
 
-			word_length = word_end - pos_find;
-			if (word_length > rootlen)
-			{
-				word = sci_get_contents_range(sci, pos_find, word_end);
-				/* search whether we already have the word in, otherwise add it */
-				if (g_slist_find_custom(words, word, (GCompareFunc)strcmp) != NULL)
-					g_free(word);
-				else
-				{
-					words = g_slist_prepend(words, word);
-					nmatches++;
-				}
+	if (! doc->priv->word_index)
+		doc->priv->word_index = word_index_new();
 
-				if (nmatches == editor_prefs.autocompletion_max_entries)
-					break;
-			}
-		}
-		ttf.chrg.cpMin = word_end;
-		pos_find = scintilla_send_message(sci, SCI_FINDTEXT, flags, (uptr_t) &ttf);
-	}
+	/* don't complete from the word being completed, as the index splits it into words */
+	word = sci_get_contents_range(sci, sci_word_start_position(sci, current, TRUE),
+		sci_word_end_position(sci, current, TRUE));
+	words = word_index_find(doc->priv->word_index, sci, root, rootlen, word,
+		editor_prefs.autocompletion_max_entries);
+	g_free(word);
 
 	return g_slist_sort(words, (GCompareFunc)utils_str_casecmp);
 }
@@ -2196,7 +2185,7 @@ static gboolean autocomplete_doc_word(GeanyEditor *editor, gchar *root, gsize ro
 	GString *str;
 	guint n_words = 0;
 
-	words = get_doc_words(sci, root, rootlen);
+	words = get_doc_words(editor->document, root, rootlen);
 	if (!words)
 	{
 		scintilla_send_message(sci, SCI_AUTOCCANCEL, 0, 0);
@@ -3001,6 +2990,9 @@ gint editor_do_uncomment(GeanyEditor *editor, gint line, gboolean toggle)
 		sel_start = sel_end = sci_get_position_from_line(editor->sci, line);
 	}
 
+	/* the styles of the lines are checked, which might not have been drawn yet */
+	sci_ensure_styled(editor->sci, sci_get_line_end_position(editor->sci, last_line));
+
 	ft = editor_get_filetype_at_line(editor, first_line);
 
 	if (! filetype_get_comment_open_close(ft, TRUE, &co, &cc))
@@ -3122,6 +3114,9 @@ void editor_do_comment_toggle(GeanyEditor *editor)
 		sel_end - editor_get_eol_char_len(editor));
 	last_line = MAX(first_line, last_line);
 
+	/* the styles of the lines are checked, which might not have been drawn yet */
+	sci_ensure_styled(editor->sci, sci_get_line_end_position(editor->sci, last_line));
+
 	first_line_start = sci_get_position_from_line(editor->sci, first_line);
 	last_line_start = sci_get_position_from_line(editor->sci, last_line);
 
@@ -3297,6 +3292,9 @@ gint editor_do_comment(GeanyEditor *editor, gint line, gboolean allow_empty_line
 		sel_start = sel_end = sci_get_position_from_line(editor->sci, line);
 	}
 
+	/* the styles of the lines are checked, which might not have been drawn yet */
+	sci_ensure_styled(editor->sci, sci_get_line_end_position(editor->sci, last_line));
+
 	ft = editor_get_filetype_at_line(editor, first_line);
 
 	if (! filetype_get_comment_open_close(ft, single_comment, &co, &cc))
@@ -4355,6 +4353,8 @@ static void fold_all(GeanyEditor *editor, gboolean want_fold)
 
 	lines = sci_get_line_count(editor->sci);
 	first = sci_get_first_visible_line(editor->sci);
+	/* all the fold levels are needed */
+	sci_ensure_styled(editor->sci, -1);
 
 	for (i = 0; i < lines; i++)
 	{
@@ -4713,6 +4713,8 @@ gboolean editor_goto_pos(GeanyEditor *editor, gint pos, gboolean mark)
 	if (G_UNLIKELY(pos < 0))
 		return FALSE;
 
+	document_ensure_loaded(editor->document);
+
 	if (mark)
 	{
 		gint line = sci_get_line_from_position(editor->sci, pos);
@@ -4758,12 +4760,17 @@ on_editor_scroll_event(GtkWidget *widget, GdkEventScroll *event, gpointer user_d
 static gboolean editor_check_colourise(GeanyEditor *editor)
 {
 	GeanyDocument *doc = editor->document;
+	gint visible_start, visible_end;
 
 	if (!doc->priv->colourise_needed)
 		return FALSE;
 
 	doc->priv->colourise_needed = FALSE;
-	sci_colourise(editor->sci, 0, -1);
+	/* Restyle only up to the end of the visible text, so the rest of the document is
+	 * invalidated. Scintilla styles it in small chunks when idle (SC_IDLESTYLING_ALL), and
+	 * sci_ensure_styled() is used where styles beyond the visible text are needed. */
+	sci_get_visible_range(editor->sci, &visible_start, &visible_end);
+	sci_colourise(editor->sci, 0, visible_end);
 
 	/* now that the current document is colourised, fold points are now accurate,
 	 * so force an update of the current function/tag. */
@@ -4913,6 +4920,11 @@ static ScintillaObject *create_new_sci(GeanyEditor *editor)
 	/* Y policy is set in editor_apply_update_prefs() */
 	SSM(sci, SCI_AUTOCSETSEPARATOR, '\n', 0);
 	SSM(sci, SCI_SETSCROLLWIDTHTRACKING, 1, 0);
+	/* style the text after the visible range when idle, so drawing and scrolling
+	 * don't have to style much at once. Unlike SC_IDLESTYLING_AFTERVISIBLE this limits
+	 * each idle step to a few milliseconds, rather than restyling up to the end of the
+	 * document after every edit. */
+	SSM(sci, SCI_SETIDLESTYLING, SC_IDLESTYLING_ALL, 0);
 
 	/* tag autocompletion images */
 	register_named_icon(sci, 1, "classviewer-var");
@@ -5133,6 +5145,49 @@ void editor_set_indentation_guides(GeanyEditor *editor)
 
 
 /* Apply non-document prefs that can change in the Preferences dialog */
+/* Starts making many edits to the text from start to end, e.g. replacing all matches.
+ * Each edit is only notified to Scintilla's own views, the document is updated for all
+ * of them at once by editor_bulk_edit_end(). */
+void editor_bulk_edit_begin(GeanyEditor *editor, gint start, gint end)
+{
+	GeanyDocument *doc = editor->document;
+
+	g_return_if_fail(! doc->priv->bulk_edit);
+
+	if (doc->priv->word_index)
+		word_index_update(doc->priv->word_index, editor->sci, start, end, FALSE);
+	doc->priv->bulk_edit = TRUE;
+	/* the start of the undo action is still needed for our undo history */
+	SSM(editor->sci, SCI_SETMODEVENTMASK, SC_STARTACTION, 0);
+}
+
+
+/* Ends the edits started by editor_bulk_edit_begin(), which changed the text from start
+ * to end into the text from start to new_end if changed is TRUE. */
+void editor_bulk_edit_end(GeanyEditor *editor, gint start, gint end, gint new_end,
+		gboolean changed)
+{
+	GeanyDocument *doc = editor->document;
+
+	g_return_if_fail(doc->priv->bulk_edit);
+
+	SSM(editor->sci, SCI_SETMODEVENTMASK, SC_MODEVENTMASKALL, 0);
+	doc->priv->bulk_edit = FALSE;
+
+	if (doc->priv->word_index)
+		word_index_update(doc->priv->word_index, editor->sci, start, changed ? new_end : end, TRUE);
+	if (! changed)
+		return;
+
+	if (editor_prefs.show_linenumber_margin)
+		auto_update_margin_width(editor);
+	doc->priv->text_version++;
+	document_update_tag_list_in_idle(doc);
+	search_mark_all_text_changed(doc, start, start - end);
+	search_mark_all_text_changed(doc, start, new_end - start);
+}
+
+
 void editor_apply_update_prefs(GeanyEditor *editor)
 {
 	ScintillaObject *sci;
@@ -324,6 +324,11 @@ void editor_set_indentation_guides(GeanyEditor *editor);
 
 void editor_apply_update_prefs(GeanyEditor *editor);
 
+void editor_bulk_edit_begin(GeanyEditor *editor, gint start, gint end);
+
+void editor_bulk_edit_end(GeanyEditor *editor, gint start, gint end, gint new_end,
+		gboolean changed);
+
 gchar *editor_get_calltip_text(GeanyEditor *editor, const TMTag *tag);
 
 void editor_toggle_fold(GeanyEditor *editor, gint line, gint modifiers);
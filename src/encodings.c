@@ -666,6 +666,53 @@ gchar *encodings_convert_to_utf8_from_charset(const gchar *buffer, gssize size,
 }
 
 
+/* What a single pass over the data tells about its encoding, so that the encodings
+ * it can't be in are skipped instead of trying to convert the whole data from them */
+typedef struct
+{
+	gboolean	 utf8;		/* valid UTF-8 without NUL bytes */
+	gboolean	 has_nul;	/* contains NUL bytes */
+} DataHints;
+
+
+/* Fills hints and returns the length of data up to the first NUL byte */
+static gsize scan_data(const gchar *data, gsize size, DataHints *hints)
+{
+	const gchar *end;
+	const gchar *nul = NULL;
+
+	hints->utf8 = g_utf8_validate(data, (gssize) size, &end);
+	/* validation stops at the first NUL byte or invalid sequence, so a NUL
+	 * byte can only follow end */
+	if (! hints->utf8)
+		nul = memchr(end, '\0', size - (gsize) (end - data));
+	hints->has_nul = (nul != NULL);
+
+	return nul != NULL ? (gsize) (nul - data) : size;
+}
+
+
+/* Whether text in charset can contain NUL bytes for other characters than U+0000 */
+static gboolean charset_allows_nul(const GeanyEncoding *enc, const gchar *charset)
+{
+	if (enc == NULL) /* e.g. UTF-16 or UCS-4 without byte order */
+		return encodings_is_unicode_charset(charset) && ! encodings_charset_equals(charset, "UTF-7");
+
+	switch (enc->idx)
+	{
+		case GEANY_ENCODING_UTF_16LE:
+		case GEANY_ENCODING_UTF_16BE:
+		case GEANY_ENCODING_UCS_2LE:
+		case GEANY_ENCODING_UCS_2BE:
+		case GEANY_ENCODING_UTF_32LE:
+		case GEANY_ENCODING_UTF_32BE:
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+
 static gchar *encodings_check_regexes(const gchar *buffer, gsize size)
 {
 	guint i;
@@ -681,21 +728,17 @@ static gchar *encodings_check_regexes(const gchar *buffer, gsize size)
 }
 
 
-static gchar *encodings_convert_to_utf8_with_suggestion(const gchar *buffer, gssize size,
-		const gchar *suggested_charset, gchar **used_encoding)
+static gchar *encodings_convert_to_utf8_with_suggestion(const gchar *buffer, gsize size,
+		const gchar *suggested_charset, const DataHints *hints, gchar **used_encoding)
 {
 	const gchar *locale_charset = NULL;
 	const gchar *charset;
+	const GeanyEncoding *enc;
 	gchar *utf8_content;
 	gboolean check_suggestion = suggested_charset != NULL;
 	gboolean check_locale = FALSE;
 	gint i, preferred_charset;
 
-	if (size == -1)
-	{
-		size = strlen(buffer);
-	}
-
 	/* current locale is not UTF-8, we have to check this charset */
 	check_locale = ! g_get_charset(&locale_charset);
 
@@ -747,9 +790,23 @@ static gchar *encodings_convert_to_utf8_with_suggestion(const gchar *buffer, gss
 		if (G_UNLIKELY(charset == NULL))
 			continue;
 
-		geany_debug("Trying to convert %" G_GSIZE_FORMAT " bytes of data from %s into UTF-8.",
-			size, charset);
-		utf8_content = encodings_convert_to_utf8_from_charset(buffer, size, charset, FALSE);
+		/* NUL bytes fail the validation of the converted data for all but the wide
+		 * Unicode encodings, and UTF-8 data has been validated already */
+		enc = (i >= 0) ? &encodings[i] : encodings_get_from_charset(charset);
+		if (hints->has_nul && ! charset_allows_nul(enc, charset))
+			continue;
+		if (enc != NULL && enc->idx == GEANY_ENCODING_UTF_8)
+		{
+			if (! hints->utf8)
+				continue;
+			utf8_content = g_strndup(buffer, size);
+		}
+		else
+		{
+			geany_debug("Trying to convert %" G_GSIZE_FORMAT " bytes of data from %s into UTF-8.",
+				size, charset);
+			utf8_content = encodings_convert_to_utf8_from_charset(buffer, size, charset, FALSE);
+		}
 
 		if (G_LIKELY(utf8_content != NULL))
 		{
@@ -786,10 +843,16 @@ gchar *encodings_convert_to_utf8(const gchar *buffer, gssize size, gchar **used_
 {
 	gchar *regex_charset;
 	gchar *utf8;
+	DataHints hints;
+
+	if (size == -1)
+		size = strlen(buffer);
+	scan_data(buffer, size, &hints);
 
 	/* first try to read the encoding from the file content */
 	regex_charset = encodings_check_regexes(buffer, size);
-	utf8 = encodings_convert_to_utf8_with_suggestion(buffer, size, regex_charset, used_encoding);
+	utf8 = encodings_convert_to_utf8_with_suggestion(buffer, size, regex_charset, &hints,
+		used_encoding);
 	g_free(regex_charset);
 
 	return utf8;
@@ -869,6 +932,7 @@ typedef struct
 	gchar		*data;	/* null-terminated data */
 	gsize		 size;	/* actual data size */
 	gsize		 len;	/* string length of data */
+	DataHints	 hints;
 	gchar		*enc;
 	gboolean	 bom;
 	gboolean	 partial;
@@ -883,7 +947,7 @@ handle_forced_encoding(BufferData *buffer, const gchar *forced_enc)
 
 	if (utils_str_equal(forced_enc, "UTF-8"))
 	{
-		if (! g_utf8_validate(buffer->data, buffer->len, NULL))
+		if (! buffer->hints.utf8 && ! g_utf8_validate(buffer->data, buffer->len, NULL))
 		{
 			return FALSE;
 		}
@@ -955,7 +1019,7 @@ handle_encoding(BufferData *buffer, GeanyEncodingIndex enc_idx)
 
 			/* try UTF-8 first */
 			if (encodings_get_idx_from_charset(regex_charset) == GEANY_ENCODING_UTF_8 &&
-				(buffer->size == buffer->len) && g_utf8_validate(buffer->data, buffer->len, NULL))
+				buffer->hints.utf8)
 			{
 				buffer->enc = g_strdup("UTF-8");
 			}
@@ -963,7 +1027,7 @@ handle_encoding(BufferData *buffer, GeanyEncodingIndex enc_idx)
 			{
 				/* detect the encoding */
 				gchar *converted_text = encodings_convert_to_utf8_with_suggestion(buffer->data,
-					buffer->size, regex_charset, &buffer->enc);
+					buffer->size, regex_charset, &buffer->hints, &buffer->enc);
 
 				if (converted_text == NULL)
 				{
@@ -1062,8 +1126,8 @@ gboolean encodings_convert_to_utf8_auto(gchar **buf, gsize *size, const gchar *f
 
 	buffer.data = *buf;
 	buffer.size = *size;
-	/* use strlen to check for null chars */
-	buffer.len = strlen(buffer.data);
+	/* check for null chars and validate UTF-8 at once */
+	buffer.len = scan_data(buffer.data, buffer.size, &buffer.hints);
 	buffer.enc = NULL;
 	buffer.bom = FALSE;
 	buffer.partial = FALSE;
@@ -1084,3 +1148,46 @@ gboolean encodings_convert_to_utf8_auto(gchar **buf, gsize *size, const gchar *f
 	*buf = buffer.data;
 	return TRUE;
 }
+
+
+/*
+ * Checks whether encodings_convert_to_utf8_auto() would use @a buf as UTF-8 data
+ * without converting it, so that it can be used as is, e.g. read straight from a file.
+ * Data with NUL bytes is never accepted, as it would be truncated.
+ *
+ * @param buf the data, not necessarily null-terminated.
+ * @param size the size of the data.
+ * @param forced_enc forced encoding to use, or @c NULL
+ * @param bom_len return location for the length of a UTF-8 BOM to skip.
+ *
+ * @return @c TRUE if the data can be used as is after skipping @a bom_len bytes.
+ */
+gboolean encodings_is_utf8_auto(const gchar *buf, gsize size, const gchar *forced_enc,
+		guint *bom_len)
+{
+	GeanyEncodingIndex enc_idx;
+	DataHints hints;
+	gchar *regex_charset;
+	gboolean ret;
+
+	enc_idx = encodings_scan_unicode_bom(buf, size, bom_len);
+	if (enc_idx != GEANY_ENCODING_UTF_8)
+		*bom_len = 0;
+	if (enc_idx != GEANY_ENCODING_NONE && enc_idx != GEANY_ENCODING_UTF_8)
+		return FALSE;
+	if (forced_enc != NULL && ! utils_str_equal(forced_enc, "UTF-8"))
+		return FALSE;
+
+	scan_data(buf + *bom_len, size - *bom_len, &hints);
+	if (! hints.utf8)
+		return FALSE;
+	if (forced_enc != NULL || enc_idx == GEANY_ENCODING_UTF_8)
+		return TRUE;
+
+	/* without a BOM, an encoding specified in the data takes precedence */
+	regex_charset = encodings_check_regexes(buf, size);
+	ret = encodings_get_idx_from_charset(regex_charset) == GEANY_ENCODING_UTF_8;
+	g_free(regex_charset);
+
+	return ret;
+}
@@ -0,0 +1,695 @@
+/*
+ *      findinfiles.c - this file is part of Geany, a fast and lightweight IDE
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Built-in Find in Files: searches the files of a directory like grep -nHI would,
+ * without spawning the grep tool. A worker thread walks the directory and a thread
+ * pool searches the files, the results are added to the Messages tab in batches.
+ *
+ * Files modified in open documents are searched in their document buffer rather
+ * than on disk. The output uses grep's file:line:text format so the messages can
+ * be parsed as usual.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "findinfiles.h"
+
+#include "document.h"
+#include "msgwindow.h"
+#include "sciwrappers.h"
+#include "support.h"
+#include "ui_utils.h"
+#include "utils.h"
+
+#include "tm_source_file.h"
+
+#include <errno.h>
+#include <string.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+
+/* interval for adding the results found so far to the Messages tab */
+#define FLUSH_INTERVAL 100
+/* like grep, files with a NUL byte in their first block are skipped as binary */
+#define BINARY_CHECK_SIZE 32768
+
+
+typedef struct
+{
+	gchar *text;
+	gsize len;
+}
+DocumentText;
+
+typedef struct
+{
+	gchar *file_name;		/* locale */
+	gchar *display_name;	/* UTF-8, relative to the searched directory */
+}
+FileTask;
+
+typedef struct
+{
+	gchar *dir;				/* locale real path of the searched directory */
+	gboolean recursive;
+	gboolean invert;
+	GPatternSpec **patterns;	/* NULL terminated, empty to search all files */
+	const gchar *enc;		/* NULL for UTF-8 */
+	gchar *search_text;		/* in the file encoding, used if regex is NULL */
+	gsize search_len;
+	GRegex *regex;
+	GRegex *raw_regex;		/* for files that aren't valid UTF-8, NULL if regex is raw */
+	GHashTable *documents;	/* locale real path -> DocumentText of modified documents */
+	GThreadPool *pool;
+	GCancellable *cancellable;
+
+	GMutex lock;			/* protects the fields below */
+	GPtrArray *results;		/* UTF-8 messages */
+	GPtrArray *errors;
+	guint n_matches;
+	gboolean done;
+}
+SearchJob;
+
+
+static SearchJob *current_job = NULL;
+
+
+static void free_document_text(gpointer data)
+{
+	DocumentText *text = data;
+
+	g_free(text->text);
+	g_slice_free(DocumentText, text);
+}
+
+
+static void search_job_free(SearchJob *job)
+{
+	g_free(job->dir);
+	utils_free_patterns(job->patterns);
+	g_free(job->search_text);
+	if (job->regex)
+		g_regex_unref(job->regex);
+	if (job->raw_regex)
+		g_regex_unref(job->raw_regex);
+	g_hash_table_destroy(job->documents);
+	g_object_unref(job->cancellable);
+	g_mutex_clear(&job->lock);
+	g_ptr_array_free(job->results, TRUE);
+	g_ptr_array_free(job->errors, TRUE);
+	g_slice_free(SearchJob, job);
+}
+
+
+static void add_error(SearchJob *job, const gchar *display_name, const gchar *message)
+{
+	g_mutex_lock(&job->lock);
+	g_ptr_array_add(job->errors, g_strdup_printf("%s: %s", display_name, message));
+	g_mutex_unlock(&job->lock);
+}
+
+
+/* Finds the first match in data[start..len), data doesn't need to be NUL terminated */
+static gboolean find_match(SearchJob *job, GRegex *regex, const gchar *data, gsize len,
+		gsize start, gsize *match_start, gsize *match_end)
+{
+	if (! regex)
+	{
+		const gchar *pos = data + start;
+		const gchar *last;
+
+		if (len - start < job->search_len)
+			return FALSE;
+
+		/* memchr() is vectorized in the C library, so skip to the candidates with it */
+		last = data + len - job->search_len;
+		while (pos <= last &&
+			(pos = memchr(pos, job->search_text[0], last - pos + 1)) != NULL)
+		{
+			if (memcmp(pos, job->search_text, job->search_len) == 0)
+			{
+				*match_start = pos - data;
+				*match_end = *match_start + job->search_len;
+				return TRUE;
+			}
+			pos++;
+		}
+		return FALSE;
+	}
+	else
+	{
+		GMatchInfo *info;
+		gboolean found;
+
+		found = g_regex_match_full(regex, data, len, start, 0, &info, NULL);
+		if (found)
+		{
+			gint s, e;
+
+			g_match_info_fetch_pos(info, 0, &s, &e);
+			*match_start = s;
+			*match_end = e;
+		}
+		g_match_info_free(info);
+		return found;
+	}
+}
+
+
+static void add_line(SearchJob *job, GPtrArray *lines, const gchar *display_name,
+		guint line, const gchar *text, gsize len)
+{
+	gchar *locale_text = g_strndup(text, len);
+	gchar *utf8_text = NULL;
+	gchar *msg;
+
+	/* enc is NULL when encoding is set to UTF-8, so we can skip any conversion */
+	if (job->enc != NULL && ! g_utf8_validate(locale_text, -1, NULL))
+		utf8_text = g_convert(locale_text, -1, "UTF-8", job->enc, NULL, NULL, NULL);
+
+	msg = g_strdup_printf("%s:%u:%s", display_name, line,
+		utf8_text ? utf8_text : locale_text);
+	g_ptr_array_add(lines, g_strchomp(msg));
+
+	g_free(utf8_text);
+	g_free(locale_text);
+}
+
+
+/* Adds the matching lines of data to lines */
+static void search_data(SearchJob *job, GRegex *regex, const gchar *data, gsize len,
+		const gchar *display_name, GPtrArray *lines)
+{
+	gsize line_start = 0;
+	gsize match_start, match_end;
+	guint line = 1;
+
+	if (job->invert)
+	{
+		while (line_start < len)
+		{
+			const gchar *nl = memchr(data + line_start, '\n', len - line_start);
+			gsize line_end = nl ? (gsize) (nl - data) : len;
+
+			if (! find_match(job, regex, data + line_start, line_end - line_start, 0,
+					&match_start, &match_end))
+				add_line(job, lines, display_name, line, data + line_start, line_end - line_start);
+			line_start = line_end + 1;
+			line++;
+		}
+		return;
+	}
+
+	/* search the whole buffer rather than each line, so lines are only looked at
+	 * around the matches */
+	while (line_start < len &&
+		find_match(job, regex, data, len, line_start, &match_start, &match_end))
+	{
+		const gchar *nl;
+		gsize line_end;
+
+		while ((nl = memchr(data + line_start, '\n', match_start - line_start)) != NULL)
+		{
+			line_start = nl - data + 1;
+			line++;
+		}
+		/* e.g. an empty match after the last newline */
+		if (line_start >= len)
+			break;
+
+		nl = memchr(data + match_start, '\n', len - match_start);
+		line_end = nl ? (gsize) (nl - data) : len;
+
+		/* a regex can match across lines, but grep only matches within a line */
+		if (match_end <= line_end ||
+			find_match(job, regex, data + line_start, line_end - line_start, 0,
+				&match_start, &match_end))
+			add_line(job, lines, display_name, line, data + line_start, line_end - line_start);
+
+		line_start = line_end + 1;
+		line++;
+	}
+}
+
+
+/* Reads a file rather than mapping it, as a mapped file that gets truncated meanwhile
+ * would crash the search thread. Returns NULL with error unset for empty and binary files. */
+static gchar *read_file(const gchar *file_name, gsize *len, GError **error)
+{
+	FILE *fp = g_fopen(file_name, "rb");
+	gchar *data;
+	gsize size = BINARY_CHECK_SIZE;
+	gsize n;
+
+	if (! fp)
+	{
+		gint err = errno;
+
+		g_set_error_literal(error, G_FILE_ERROR, g_file_error_from_errno(err),
+			g_strerror(err));
+		return NULL;
+	}
+
+	/* look for binary data before reading the rest of the file */
+	data = g_malloc(size + 1);
+	*len = fread(data, 1, size, fp);
+	if (*len == 0 || memchr(data, '\0', *len) != NULL)
+	{
+		g_free(data);
+		data = NULL;
+	}
+	else
+	{
+		while (*len == size)
+		{
+			size *= 2;
+			data = g_realloc(data, size + 1);
+			n = fread(data + *len, 1, size - *len, fp);
+			*len += n;
+			if (n == 0)
+				break;
+		}
+		data[*len] = '\0';
+	}
+	if (ferror(fp))
+	{
+		gint err = errno;
+
+		g_set_error_literal(error, G_FILE_ERROR, g_file_error_from_errno(err),
+			g_strerror(err));
+		g_free(data);
+		data = NULL;
+	}
+	fclose(fp);
+	return data;
+}
+
+
+static void search_file(SearchJob *job, FileTask *task)
+{
+	DocumentText *doc_text = g_hash_table_lookup(job->documents, task->file_name);
+	gchar *contents = NULL;
+	GRegex *regex = job->regex;
+	GPtrArray *lines;
+	const gchar *data;
+	gsize len;
+
+	if (doc_text)
+	{
+		data = doc_text->text;
+		len = doc_text->len;
+	}
+	else
+	{
+		GError *error = NULL;
+
+		contents = read_file(task->file_name, &len, &error);
+		if (! contents)
+		{
+			if (error)
+			{
+				add_error(job, task->display_name, error->message);
+				g_error_free(error);
+			}
+			return;
+		}
+		data = contents;
+	}
+
+	/* the UTF-8 regex would read past invalid sequences */
+	if (job->raw_regex && ! g_utf8_validate(data, len, NULL))
+		regex = job->raw_regex;
+
+	lines = g_ptr_array_new();
+	search_data(job, regex, data, len, task->display_name, lines);
+	if (lines->len > 0)
+	{
+		guint i;
+
+		g_mutex_lock(&job->lock);
+		for (i = 0; i < lines->len; i++)
+			g_ptr_array_add(job->results, lines->pdata[i]);
+		job->n_matches += lines->len;
+		g_mutex_unlock(&job->lock);
+	}
+	g_ptr_array_free(lines, TRUE);
+
+	g_free(contents);
+}
+
+
+static void search_file_job(gpointer data, gpointer pool_data)
+{
+	SearchJob *job = pool_data;
+	FileTask *task = data;
+
+	if (! g_cancellable_is_cancelled(job->cancellable))
+		search_file(job, task);
+
+	g_free(task->file_name);
+	g_free(task->display_name);
+	g_slice_free(FileTask, task);
+}
+
+
+static void queue_file(SearchJob *job, gchar *file_name, gchar *display_name)
+{
+	FileTask *task = g_slice_new(FileTask);
+
+	task->file_name = file_name;
+	task->display_name = display_name;
+	g_thread_pool_push(job->pool, task, NULL);
+}
+
+
+/* display_dir is NULL for the searched directory when not recursing, so the
+ * file names are shown like grep shows its arguments */
+static void scan_dir(SearchJob *job, const gchar *path, const gchar *display_dir)
+{
+	GError *error = NULL;
+	GDir *dir;
+	const gchar *name;
+
+	if (g_cancellable_is_cancelled(job->cancellable))
+		return;
+	dir = g_dir_open(path, 0, &error);
+	if (! dir)
+	{
+		add_error(job, display_dir ? display_dir : ".", error->message);
+		g_error_free(error);
+		return;
+	}
+
+	while ((name = g_dir_read_name(dir)) != NULL)
+	{
+		gchar *file_name = g_build_filename(path, name, NULL);
+		gchar *utf8_name = utils_get_utf8_from_locale(name);
+		gchar *display_name = display_dir ?
+			g_build_filename(display_dir, utf8_name, NULL) : g_strdup(utf8_name);
+
+		g_free(utf8_name);
+		/* like grep -r, don't follow links found while recursing */
+		if (job->recursive && g_file_test(file_name, G_FILE_TEST_IS_SYMLINK))
+			;
+		else if (job->recursive && g_file_test(file_name, G_FILE_TEST_IS_DIR))
+			scan_dir(job, file_name, display_name);
+		else if (utils_match_patterns(job->patterns, name) &&
+			g_file_test(file_name, G_FILE_TEST_IS_REGULAR))
+		{
+			queue_file(job, file_name, display_name);
+			continue;
+		}
+		g_free(file_name);
+		g_free(display_name);
+	}
+	g_dir_close(dir);
+}
+
+
+static gpointer search_job_run(gpointer data)
+{
+	SearchJob *job = data;
+
+	scan_dir(job, job->dir, job->recursive ? "." : NULL);
+	/* waits until all the queued files are searched */
+	g_thread_pool_free(job->pool, FALSE, TRUE);
+	job->pool = NULL;
+
+	/* the job belongs to the main thread after this */
+	g_mutex_lock(&job->lock);
+	job->done = TRUE;
+	g_mutex_unlock(&job->lock);
+
+	return NULL;
+}
+
+
+static void search_job_finish(SearchJob *job)
+{
+	if (job->n_matches > 0)
+	{
+		gchar *text = ngettext(
+					"Search completed with %d match.",
+					"Search completed with %d matches.", job->n_matches);
+
+		msgwin_msg_add(COLOR_BLUE, -1, NULL, text, job->n_matches);
+		ui_set_statusbar(FALSE, text, job->n_matches);
+	}
+	else
+	{
+		const gchar *msg = _("No matches found.");
+
+		msgwin_msg_add_string(COLOR_BLUE, -1, NULL, msg);
+		ui_set_statusbar(FALSE, "%s", msg);
+	}
+	utils_beep();
+	ui_progress_bar_stop();
+}
+
+
+/* Adds the results found since the last call to the Messages tab, runs in the main thread */
+static gboolean flush_results(gpointer data)
+{
+	SearchJob *job = data;
+	GPtrArray *results, *errors;
+	gboolean done;
+	guint i;
+
+	g_mutex_lock(&job->lock);
+	results = job->results;
+	errors = job->errors;
+	job->results = g_ptr_array_new_with_free_func(g_free);
+	job->errors = g_ptr_array_new_with_free_func(g_free);
+	done = job->done;
+	g_mutex_unlock(&job->lock);
+
+	/* a new search might have been started meanwhile */
+	if (! g_cancellable_is_cancelled(job->cancellable))
+	{
+		for (i = 0; i < errors->len; i++)
+			msgwin_msg_add_string(COLOR_DARK_RED, -1, NULL, errors->pdata[i]);
+		for (i = 0; i < results->len; i++)
+			msgwin_msg_add_string(COLOR_BLACK, -1, NULL, results->pdata[i]);
+		if (done)
+			search_job_finish(job);
+	}
+	g_ptr_array_free(results, TRUE);
+	g_ptr_array_free(errors, TRUE);
+
+	if (! done)
+		return TRUE;
+
+	if (current_job == job)
+		current_job = NULL;
+	search_job_free(job);
+	return FALSE;
+}
+
+
+/* Escapes text for a regex byte-wise, as it's not UTF-8 with other file encodings */
+static gchar *escape_regex(const gchar *text)
+{
+	GString *str = g_string_sized_new(strlen(text) * 2);
+	const gchar *c;
+
+	for (c = text; *c; c++)
+	{
+		if ((guchar) *c < 0x80 && ! g_ascii_isalnum(*c))
+			g_string_append_c(str, '\\');
+		g_string_append_c(str, *c);
+	}
+	return g_string_free(str, FALSE);
+}
+
+
+static gboolean compile_search(SearchJob *job, const gchar *search_text, GeanyFindFlags flags)
+{
+	GRegexCompileFlags cflags = G_REGEX_MULTILINE | G_REGEX_OPTIMIZE;
+	GError *error = NULL;
+	gchar *pattern;
+
+	/* plain case sensitive text is matched without a regex */
+	if (! (flags & (GEANY_FIND_REGEXP | GEANY_FIND_WHOLEWORD)) && (flags & GEANY_FIND_MATCHCASE))
+	{
+		job->search_text = g_strdup(search_text);
+		job->search_len = strlen(search_text);
+		return TRUE;
+	}
+
+	pattern = (flags & GEANY_FIND_REGEXP) ? g_strdup(search_text) : escape_regex(search_text);
+	if (flags & GEANY_FIND_WHOLEWORD)
+		SETPTR(pattern, g_strconcat("(?<!\\w)(?:", pattern, ")(?!\\w)", NULL));
+	if (! (flags & GEANY_FIND_MATCHCASE))
+		cflags |= G_REGEX_CASELESS;
+
+	/* the search text is in the file encoding when it isn't UTF-8 */
+	job->regex = g_regex_new(pattern, cflags | (job->enc ? G_REGEX_RAW : 0), 0, &error);
+	if (job->regex && ! job->enc)
+		job->raw_regex = g_regex_new(pattern, cflags | G_REGEX_RAW, 0, NULL);
+	g_free(pattern);
+
+	if (! job->regex)
+	{
+		ui_set_statusbar(FALSE, _("Bad regex: %s"), error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+
+static gboolean is_in_dir(const gchar *file_name, const gchar *dir)
+{
+	gsize len = strlen(dir);
+
+	return strncmp(file_name, dir, len) == 0 &&
+		(file_name[len] == G_DIR_SEPARATOR || (len > 0 && dir[len - 1] == G_DIR_SEPARATOR));
+}
+
+
+/* Takes a copy of the modified documents in the searched directory, so the search
+ * sees the unsaved changes */
+static void add_documents(SearchJob *job)
+{
+	guint i;
+
+	foreach_document(i)
+	{
+		GeanyDocument *doc = documents[i];
+		DocumentText *text;
+		gchar *contents;
+		gsize len;
+
+		if (! doc->changed || ! doc->real_path || ! is_in_dir(doc->real_path, job->dir))
+			continue;
+
+		len = sci_get_length(doc->editor->sci);
+		contents = sci_get_contents(doc->editor->sci, len + 1);
+		if (job->enc)
+		{
+			gchar *converted = g_convert(contents, len, job->enc, "UTF-8", NULL, &len, NULL);
+
+			g_free(contents);
+			/* the file on disk is searched instead */
+			if (! converted)
+				continue;
+			contents = converted;
+		}
+
+		text = g_slice_new(DocumentText);
+		text->text = contents;
+		text->len = len;
+		g_hash_table_insert(job->documents, g_strdup(doc->real_path), text);
+	}
+}
+
+
+/* Starts searching the files in utf8_dir in the background, the results are shown in the
+ * Messages tab. A running search is cancelled.
+ * @param patterns Space separated glob patterns of the file names to search, or NULL.
+ * @param enc The file encoding, or NULL for UTF-8.
+ * @return TRUE if the search was started. */
+gboolean find_in_files_start(const gchar *utf8_search_text, const gchar *utf8_dir,
+		GeanyFindFlags flags, gboolean invert, gboolean recursive,
+		const gchar *patterns, const gchar *enc)
+{
+	SearchJob *job;
+	gchar *dir, *search_text = NULL, *utf8_str;
+	gchar **pattern_strv;
+	gsize utf8_text_len;
+
+	g_return_val_if_fail(! EMPTY(utf8_search_text) && utf8_dir != NULL, FALSE);
+
+	dir = utils_get_locale_from_utf8(utf8_dir);
+	if (! g_file_test(dir, G_FILE_TEST_IS_DIR))
+	{
+		ui_set_statusbar(FALSE, _("Invalid directory for find in files."));
+		g_free(dir);
+		return FALSE;
+	}
+
+	/* convert the search text in the preferred encoding (if the text is not valid UTF-8. assume
+	 * it is already in the preferred encoding) */
+	utf8_text_len = strlen(utf8_search_text);
+	if (enc != NULL && g_utf8_validate(utf8_search_text, utf8_text_len, NULL))
+		search_text = g_convert(utf8_search_text, utf8_text_len, enc, "UTF-8", NULL, NULL, NULL);
+	if (search_text == NULL)
+		search_text = g_strdup(utf8_search_text);
+
+	job = g_slice_new0(SearchJob);
+	job->enc = enc;
+	if (! compile_search(job, search_text, flags))
+	{
+		g_free(search_text);
+		g_free(dir);
+		g_slice_free(SearchJob, job);
+		return FALSE;
+	}
+	g_free(search_text);
+
+	job->dir = tm_get_real_path(dir);
+	if (! job->dir)
+		job->dir = g_strdup(dir);
+	job->recursive = recursive;
+	job->invert = invert;
+	pattern_strv = g_strsplit_set(patterns ? patterns : "", " \t", -1);
+	job->patterns = utils_compile_patterns(pattern_strv);
+	g_strfreev(pattern_strv);
+	job->documents = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_document_text);
+	add_documents(job);
+	job->cancellable = g_cancellable_new();
+	g_mutex_init(&job->lock);
+	job->results = g_ptr_array_new_with_free_func(g_free);
+	job->errors = g_ptr_array_new_with_free_func(g_free);
+	job->pool = g_thread_pool_new(search_file_job, job, utils_get_num_processors(), FALSE, NULL);
+
+	if (current_job)
+		g_cancellable_cancel(current_job->cancellable);
+	current_job = job;
+
+	msgwin_clear_tab(MSG_MESSAGE);
+	gtk_notebook_set_current_page(GTK_NOTEBOOK(msgwindow.notebook), MSG_MESSAGE);
+	ui_progress_bar_start(_("Searching..."));
+	msgwin_set_messages_dir(dir);
+	utf8_str = g_strdup_printf(_("Searching for \"%s\" (in directory: %s)"),
+		utf8_search_text, utf8_dir);
+	msgwin_msg_add_string(COLOR_BLUE, -1, NULL, utf8_str);
+	g_free(utf8_str);
+	g_free(dir);
+
+	g_timeout_add(FLUSH_INTERVAL, flush_results, job);
+	g_thread_unref(g_thread_new("find-in-files", search_job_run, job));
+
+	return TRUE;
+}
+
+
+/* Stops the running search, if any */
+void find_in_files_finalize(void)
+{
+	if (current_job)
+	{
+		g_cancellable_cancel(current_job->cancellable);
+		current_job = NULL;
+	}
+}
@@ -1567,9 +1567,9 @@ static gboolean cb_func_search_action(guint key_id)
 				text = get_current_word_or_sel(doc, TRUE);
 
 			if (sci_has_selection(sci))
-				search_mark_all(doc, text, GEANY_FIND_MATCHCASE);
+				search_mark_all(doc, text, GEANY_FIND_MATCHCASE, NULL);
 			else
-				search_mark_all(doc, text, GEANY_FIND_MATCHCASE | GEANY_FIND_WHOLEWORD);
+				search_mark_all(doc, text, GEANY_FIND_MATCHCASE | GEANY_FIND_WHOLEWORD, NULL);
 
 			g_free(text);
 			break;
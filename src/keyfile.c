@@ -37,6 +37,7 @@
 #include "app.h"
 #include "build.h"
 #include "document.h"
+#include "documentprivate.h"
 #include "encodings.h"
 #include "encodingsprivate.h"
 #include "filetypes.h"
@@ -93,7 +94,6 @@
 #define GEANY_DEFAULT_FONT_EDITOR		"Monospace 10"
 #endif
 #define GEANY_DEFAULT_TOOLS_PRINTCMD	"lpr"
-#define GEANY_DEFAULT_TOOLS_GREP		"grep"
 #define GEANY_DEFAULT_MRU_LENGTH		10
 #define GEANY_TOGGLE_MARK				"~ "
 #define GEANY_MAX_AUTOCOMPLETE_WORDS	30
@@ -248,6 +248,10 @@ static void init_pref_groups(void)
 		"show_keep_edit_history_on_reload_msg", TRUE);
 	stash_group_add_boolean(group, &file_prefs.reload_clean_doc_on_file_change,
 		"reload_clean_doc_on_file_change", FALSE);
+	stash_group_add_boolean(group, &file_prefs.lazy_session_tabs,
+		"lazy_session_tabs", FALSE);
+	stash_group_add_boolean(group, &project_prefs.index_files,
+		"index_project_files", FALSE);
 	/* for backwards-compatibility */
 	stash_group_add_integer(group, &editor_prefs.indentation->hard_tab_width,
 		"indent_hard_tab_width", 8);
@@ -331,6 +335,8 @@ static gchar *get_session_file_string(GeanyDocument *doc)
 	gchar *locale_filename;
 	gchar *escaped_filename;
 	GeanyFiletype *ft = doc->file_type;
+	/* the cursor of a document not yet loaded is still the restored position */
+	gint pos = doc->priv->lazy ? doc->priv->lazy_pos : sci_get_current_position(doc->editor->sci);
 
 	if (ft == NULL) /* can happen when saving a new file when quitting */
 		ft = filetypes[GEANY_FILETYPES_NONE];
@@ -339,7 +345,7 @@ static gchar *get_session_file_string(GeanyDocument *doc)
 	escaped_filename = g_uri_escape_string(locale_filename, NULL, TRUE);
 
 	fname = g_strdup_printf("%d;%s;%d;E%s;%d;%d;%d;%s;%d;%d",
-		sci_get_current_position(doc->editor->sci),
+		pos,
 		ft->name,
 		doc->readonly,
 		doc->encoding,
@@ -1147,6 +1153,29 @@ gboolean configuration_load(void)
 }
 
 
+static const gchar *get_session_file_encoding(gchar **tmp)
+{
+	if (isdigit(tmp[3][0]))
+		return encodings_get_charset_from_index(atoi(tmp[3]));
+	else
+		return &(tmp[3][1]);
+}
+
+
+/* starts loading the session file in the background while previous files are opened */
+static void prefetch_session_file(gchar **tmp)
+{
+	gchar *unescaped_filename = g_uri_unescape_string(tmp[7], NULL);
+	gchar *locale_filename = utils_get_locale_from_utf8(unescaped_filename);
+
+	if (g_file_test(locale_filename, G_FILE_TEST_IS_REGULAR))
+		document_prefetch_file(locale_filename, get_session_file_encoding(tmp));
+
+	g_free(locale_filename);
+	g_free(unescaped_filename);
+}
+
+
 static gboolean open_session_file(gchar **tmp, guint len)
 {
 	guint pos;
@@ -1163,14 +1192,7 @@ static gboolean open_session_file(gchar **tmp, guint len)
 	pos = atoi(tmp[0]);
 	ft_name = tmp[1];
 	ro = atoi(tmp[2]);
-	if (isdigit(tmp[3][0]))
-	{
-		encoding = encodings_get_charset_from_index(atoi(tmp[3]));
-	}
-	else
-	{
-		encoding = &(tmp[3][1]);
-	}
+	encoding = get_session_file_encoding(tmp);
 	indent_type = atoi(tmp[4]);
 	auto_indent = atoi(tmp[5]);
 	line_wrapping = atoi(tmp[6]);
@@ -1184,8 +1206,12 @@ static gboolean open_session_file(gchar **tmp, guint len)
 	if (g_file_test(locale_filename, G_FILE_TEST_IS_REGULAR))
 	{
 		GeanyFiletype *ft = filetypes_lookup_by_name(ft_name);
-		GeanyDocument *doc = document_open_file_full(
-			NULL, locale_filename, pos, ro, ft, encoding);
+		GeanyDocument *doc;
+
+		if (file_prefs.lazy_session_tabs && ft != NULL)
+			doc = document_open_file_lazy(locale_filename, pos, ro, ft, encoding);
+		else
+			doc = document_open_file_full(NULL, locale_filename, pos, ro, ft, encoding);
 
 		if (doc)
 		{
@@ -1216,12 +1242,23 @@ static gboolean open_session_file(gchar **tmp, guint len)
  * for all files opened within this function */
 void configuration_open_files(void)
 {
+	GeanyDocument *doc;
 	gint i;
 	gboolean failure = FALSE;
 
 	/* necessary to set it to TRUE for project session support */
 	main_status.opening_session_files = TRUE;
 
+	/* read and decode the files in the background in the order they are opened */
+	for (i = 0; i < (gint)session_files->len && ! file_prefs.lazy_session_tabs; i++)
+	{
+		gint j = file_prefs.tab_order_ltr ? i : ((gint)session_files->len - 1 - i);
+		gchar **tmp = g_ptr_array_index(session_files, j);
+
+		if (tmp != NULL && g_strv_length(tmp) >= 8)
+			prefetch_session_file(tmp);
+	}
+
 	i = file_prefs.tab_order_ltr ? 0 : (session_files->len - 1);
 	while (TRUE)
 	{
@@ -1251,6 +1288,7 @@ void configuration_open_files(void)
 
 	g_ptr_array_free(session_files, TRUE);
 	session_files = NULL;
+	document_prefetch_finish();
 
 	if (failure)
 		ui_set_statusbar(TRUE, _("Failed to load one or more session files."));
@@ -1270,6 +1308,11 @@ void configuration_open_files(void)
 		gtk_notebook_set_current_page(GTK_NOTEBOOK(main_widgets.notebook), target_page);
 	}
 	main_status.opening_session_files = FALSE;
+
+	/* the visible document must be loaded even if no page switch happened */
+	doc = document_get_current();
+	if (doc != NULL)
+		document_ensure_loaded(doc);
 }
 
 
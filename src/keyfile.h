@@ -27,6 +27,9 @@
 
 G_BEGIN_DECLS
 
+/* the default grep tool, Find in Files uses its built-in search instead */
+#define GEANY_DEFAULT_TOOLS_GREP		"grep"
+
 extern GPtrArray *pref_groups;
 
 
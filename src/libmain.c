@@ -49,6 +49,7 @@
 #include "plugins.h"
 #include "prefs.h"
 #include "printing.h"
+#include "projectindex.h"
 #include "sidebar.h"
 #ifdef HAVE_SOCKET
 # include "socket.h"
@@ -1117,6 +1118,15 @@ gint main_lib(gint argc, gchar **argv)
 	geany_debug("User config dir: %s", utf8_configdir);
 	g_free(utf8_configdir);
 
+	if (config_dir_result == 0)
+	{
+		/* reuse the tags of unchanged files from previous sessions */
+		gchar *tag_cache_dir = g_build_filename(app->configdir, GEANY_TAG_CACHE_SUBDIR, NULL);
+
+		tm_workspace_set_tag_cache_dir(tag_cache_dir);
+		g_free(tag_cache_dir);
+	}
+
 	/* create the object so Geany signals can be connected in init() functions */
 	geany_object = geany_object_new();
 
@@ -1146,6 +1156,7 @@ gint main_lib(gint argc, gchar **argv)
 	filetypes_init();
 	templates_init();
 	navqueue_init();
+	project_index_init();
 	document_init_doclist();
 	symbols_init();
 	editor_snippets_init();
@@ -1267,6 +1278,7 @@ static void do_main_quit(void)
 #endif
 
 	navqueue_free();
+	project_index_finalize();
 	keybindings_free();
 	notebook_free();
 	highlighting_free_styles();
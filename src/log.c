@@ -40,6 +40,8 @@
 # include <locale.h>
 #endif
 
+/* messages can be logged from worker threads too */
+G_LOCK_DEFINE_STATIC(log_buffer);
 static GString *log_buffer = NULL;
 static GtkTextBuffer *dialog_textbuffer = NULL;
 
@@ -55,8 +57,14 @@ static void update_dialog(void)
 	{
 		GtkTextMark *mark;
 		GtkTextView *textview = g_object_get_data(G_OBJECT(dialog_textbuffer), "textview");
+		gchar *text;
 
-		gtk_text_buffer_set_text(dialog_textbuffer, log_buffer->str, log_buffer->len);
+		G_LOCK(log_buffer);
+		text = g_strndup(log_buffer->str, log_buffer->len);
+		G_UNLOCK(log_buffer);
+
+		gtk_text_buffer_set_text(dialog_textbuffer, text, -1);
+		g_free(text);
 		/* scroll to the end of the messages as this might be most interesting */
 		mark = gtk_text_buffer_get_insert(dialog_textbuffer);
 		gtk_text_view_scroll_to_mark(textview, mark, 0.0, FALSE, 0.0, 0.0);
@@ -64,6 +72,38 @@ static void update_dialog(void)
 }
 
 
+static gboolean update_dialog_idle(gpointer data)
+{
+	update_dialog();
+	return FALSE;
+}
+
+
+/* Updates the dialog after a message was logged, possibly from another thread */
+static void queue_update_dialog(void)
+{
+	if (dialog_textbuffer == NULL)
+		return;
+
+	/* GTK must only be used from the main thread */
+	if (g_main_context_is_owner(NULL))
+		update_dialog();
+	else
+		g_idle_add(update_dialog_idle, NULL);
+}
+
+
+static void append_to_log(const gchar *msg)
+{
+	G_LOCK(log_buffer);
+	if (G_LIKELY(log_buffer != NULL))
+		g_string_append(log_buffer, msg);
+	G_UNLOCK(log_buffer);
+
+	queue_update_dialog();
+}
+
+
 /* Geany's main debug/log function, declared in geany.h */
 void geany_debug(gchar const *format, ...)
 {
@@ -76,23 +116,21 @@ void geany_debug(gchar const *format, ...)
 
 static void handler_print(const gchar *msg)
 {
-	printf("%s\n", msg);
-	if (G_LIKELY(log_buffer != NULL))
-	{
-		g_string_append_printf(log_buffer, "%s\n", msg);
-		update_dialog();
-	}
+	gchar *line = g_strconcat(msg, "\n", NULL);
+
+	printf("%s", line);
+	append_to_log(line);
+	g_free(line);
 }
 
 
 static void handler_printerr(const gchar *msg)
 {
-	fprintf(stderr, "%s\n", msg);
-	if (G_LIKELY(log_buffer != NULL))
-	{
-		g_string_append_printf(log_buffer, "%s\n", msg);
-		update_dialog();
-	}
+	gchar *line = g_strconcat(msg, "\n", NULL);
+
+	fprintf(stderr, "%s", line);
+	append_to_log(line);
+	g_free(line);
 }
 
 
@@ -120,6 +158,7 @@ static const gchar *get_log_prefix(GLogLevelFlags log_level)
 static void handler_log(const gchar *domain, GLogLevelFlags level, const gchar *msg, gpointer data)
 {
 	gchar *time_str;
+	gchar *line;
 
 	if (G_LIKELY(app != NULL && app->debug_mode) ||
 		! ((G_LOG_LEVEL_DEBUG | G_LOG_LEVEL_INFO | G_LOG_LEVEL_MESSAGE) & level))
@@ -139,13 +178,13 @@ static void handler_log(const gchar *domain, GLogLevelFlags level, const gchar *
 	}
 
 	time_str = utils_get_current_time_string();
-
-	g_string_append_printf(log_buffer, "%s: %s %s: %s\n", time_str, domain,
+	line = g_strdup_printf("%s: %s %s: %s\n", time_str, domain,
 		get_log_prefix(level), msg);
 
-	g_free(time_str);
+	append_to_log(line);
 
-	update_dialog();
+	g_free(line);
+	g_free(time_str);
 }
 
 
@@ -169,7 +208,9 @@ static void on_dialog_response(GtkDialog *dialog, gint response, gpointer user_d
 		gtk_text_buffer_get_end_iter(dialog_textbuffer, &end_iter);
 		gtk_text_buffer_delete(dialog_textbuffer, &start_iter, &end_iter);
 
+		G_LOCK(log_buffer);
 		g_string_erase(log_buffer, 0, -1);
+		G_UNLOCK(log_buffer);
 	}
 	else
 	{
@@ -220,6 +261,8 @@ void log_finalize(void)
 {
 	g_log_set_default_handler(g_log_default_handler, NULL);
 
+	G_LOCK(log_buffer);
 	g_string_free(log_buffer, TRUE);
 	log_buffer = NULL;
+	G_UNLOCK(log_buffer);
 }
@@ -64,8 +64,31 @@ typedef struct
 }
 ParseData;
 
+/* a message waiting to be added to the Messages or Compiler tab */
+typedef struct
+{
+	const GdkColor *color;
+	gint line;
+	guint doc_id;
+	gchar *string;			/* UTF-8 */
+}
+PendingMessage;
+
+/* interval for adding the pending messages, about a frame */
+#define FLUSH_INTERVAL 20
+
 MessageWindow msgwindow;
 
+/* Messages are added in batches rather than one by one, so that a build or a search
+ * producing lots of messages doesn't keep the view busy with every single row */
+static struct
+{
+	GArray *msg;			/* PendingMessage */
+	GArray *compiler;		/* PendingMessage */
+	guint flush_id;
+}
+pending = {NULL, NULL, 0};
+
 enum
 {
 	MSG_COL_LINE = 0,
@@ -121,6 +144,9 @@ void msgwin_init(void)
 	msgwindow.scribble = ui_lookup_widget(main_widgets.window, "textview_scribble");
 	msgwindow.messages_dir = NULL;
 
+	pending.msg = g_array_new(FALSE, FALSE, sizeof(PendingMessage));
+	pending.compiler = g_array_new(FALSE, FALSE, sizeof(PendingMessage));
+
 	prepare_status_tree_view();
 	prepare_msg_tree_view();
 	prepare_compiler_tree_view();
@@ -133,8 +159,24 @@ void msgwin_init(void)
 }
 
 
+static void clear_pending(GArray *messages)
+{
+	guint i;
+
+	for (i = 0; i < messages->len; i++)
+		g_free(g_array_index(messages, PendingMessage, i).string);
+	g_array_set_size(messages, 0);
+}
+
+
 void msgwin_finalize(void)
 {
+	if (pending.flush_id)
+		g_source_remove(pending.flush_id);
+	clear_pending(pending.msg);
+	clear_pending(pending.compiler);
+	g_array_free(pending.msg, TRUE);
+	g_array_free(pending.compiler, TRUE);
 	g_free(msgwindow.messages_dir);
 }
 
@@ -301,21 +343,24 @@ void msgwin_compiler_add(gint msg_color, const gchar *format, ...)
 }
 
 
-void msgwin_compiler_add_string(gint msg_color, const gchar *msg)
+static void flush_compiler_messages(void)
 {
 	GtkTreeIter iter;
-	const GdkColor *color = get_color(msg_color);
-	gchar *utf8_msg;
+	guint i;
 
-	if (! g_utf8_validate(msg, -1, NULL))
-		utf8_msg = utils_get_utf8_from_locale(msg);
-	else
-		utf8_msg = (gchar *) msg;
+	if (pending.compiler->len == 0)
+		return;
 
-	gtk_list_store_append(msgwindow.store_compiler, &iter);
-	gtk_list_store_set(msgwindow.store_compiler, &iter,
-		COMPILER_COL_COLOR, color, COMPILER_COL_STRING, utf8_msg, -1);
+	for (i = 0; i < pending.compiler->len; i++)
+	{
+		PendingMessage *msg = &g_array_index(pending.compiler, PendingMessage, i);
+
+		gtk_list_store_insert_with_values(msgwindow.store_compiler, &iter, -1,
+			COMPILER_COL_COLOR, msg->color, COMPILER_COL_STRING, msg->string, -1);
+	}
+	clear_pending(pending.compiler);
 
+	/* iter is the last row added */
 	if (ui_prefs.msgwindow_visible && interface_prefs.compiler_tab_autoscroll)
 	{
 		GtkTreePath *path = gtk_tree_model_get_path(
@@ -325,12 +370,72 @@ void msgwin_compiler_add_string(gint msg_color, const gchar *msg)
 		gtk_tree_path_free(path);
 	}
 
-	/* calling build_menu_update for every build message would be overkill, TODO really should call it once when all done */
+	/* the rest of the build menu is updated by build_menu_update() when the build is done */
 	gtk_widget_set_sensitive(build_get_menu_items(-1)->menu_item[GBG_FIXED][GBF_NEXT_ERROR], TRUE);
 	gtk_widget_set_sensitive(build_get_menu_items(-1)->menu_item[GBG_FIXED][GBF_PREV_ERROR], TRUE);
+}
+
+
+static void flush_messages(void)
+{
+	GtkTreeIter iter;
+	guint i;
+
+	for (i = 0; i < pending.msg->len; i++)
+	{
+		PendingMessage *msg = &g_array_index(pending.msg, PendingMessage, i);
 
-	if (utf8_msg != msg)
-		g_free(utf8_msg);
+		gtk_list_store_insert_with_values(msgwindow.store_msg, &iter, -1,
+			MSG_COL_LINE, msg->line, MSG_COL_DOC_ID, msg->doc_id, MSG_COL_COLOR,
+			msg->color, MSG_COL_STRING, msg->string, -1);
+	}
+	clear_pending(pending.msg);
+}
+
+
+/* Adds the pending messages to the Messages and Compiler tabs. Call this before
+ * reading their list stores. */
+void msgwin_flush(void)
+{
+	if (pending.flush_id)
+	{
+		g_source_remove(pending.flush_id);
+		pending.flush_id = 0;
+	}
+	flush_compiler_messages();
+	flush_messages();
+}
+
+
+static gboolean on_flush_timeout(gpointer data)
+{
+	pending.flush_id = 0;
+	msgwin_flush();
+	return FALSE;
+}
+
+
+static void add_pending(GArray *messages, const GdkColor *color, gint line, guint doc_id,
+		gchar *string)
+{
+	PendingMessage msg = {color, line, doc_id, string};
+
+	g_array_append_val(messages, msg);
+	if (! pending.flush_id)
+		pending.flush_id = g_timeout_add(FLUSH_INTERVAL, on_flush_timeout, NULL);
+}
+
+
+void msgwin_compiler_add_string(gint msg_color, const gchar *msg)
+{
+	gchar *utf8_msg;
+
+	if (! g_utf8_validate(msg, -1, NULL))
+		utf8_msg = utils_get_utf8_from_locale(msg);
+	else
+		utf8_msg = g_strdup(msg);
+
+	add_pending(pending.compiler, get_color(msg_color), -1, 0, utf8_msg);
 }
 
 
@@ -379,8 +484,6 @@ void msgwin_msg_add(gint msg_color, gint line, GeanyDocument *doc, const gchar *
 /* adds string to the msg treeview */
 void msgwin_msg_add_string(gint msg_color, gint line, GeanyDocument *doc, const gchar *string)
 {
-	GtkTreeIter iter;
-	const GdkColor *color = get_color(msg_color);
 	gchar *tmp;
 	gsize len;
 	gchar *utf8_msg;
@@ -398,18 +501,14 @@ void msgwin_msg_add_string(gint msg_color, gint line, GeanyDocument *doc, const
 		tmp = g_strdup(string);
 
 	if (! g_utf8_validate(tmp, -1, NULL))
+	{
 		utf8_msg = utils_get_utf8_from_locale(tmp);
+		g_free(tmp);
+	}
 	else
 		utf8_msg = tmp;
 
-	gtk_list_store_append(msgwindow.store_msg, &iter);
-	gtk_list_store_set(msgwindow.store_msg, &iter,
-		MSG_COL_LINE, line, MSG_COL_DOC_ID, doc ? doc->id : 0, MSG_COL_COLOR,
-		color, MSG_COL_STRING, utf8_msg, -1);
-
-	g_free(tmp);
-	if (utf8_msg != tmp)
-		g_free(utf8_msg);
+	add_pending(pending.msg, get_color(msg_color), line, doc ? doc->id : 0, utf8_msg);
 }
 
 
@@ -531,6 +630,7 @@ static void on_compiler_treeview_copy_all_activate(GtkMenuItem *menuitem, gpoint
 		break;
 	}
 
+	msgwin_flush();
 	/* walk through the list and copy every line into a string */
 	valid = gtk_tree_model_get_iter_first(GTK_TREE_MODEL(store), &iter);
 	while (valid)
@@ -1015,7 +1115,8 @@ void msgwin_parse_compiler_error_line(const gchar *string, const gchar *dir,
 		gchar **filename, gint *line)
 {
 	GeanyFiletype *ft;
-	gchar *trimmed_string, *utf8_dir;
+	const gchar *trimmed_string;
+	gchar *utf8_dir;
 
 	*filename = NULL;
 	*line = -1;
@@ -1023,14 +1124,14 @@ void msgwin_parse_compiler_error_line(const gchar *string, const gchar *dir,
 	if (G_UNLIKELY(string == NULL))
 		return;
 
-	if (dir == NULL)
-		utf8_dir = utils_get_utf8_from_locale(build_info.dir);
-	else
-		utf8_dir = g_strdup(dir);
-	g_return_if_fail(utf8_dir != NULL);
+	/* every error message format needs a line number, so most of the output of a
+	 * build can be skipped without parsing it */
+	if (strpbrk(string, "0123456789") == NULL)
+		return;
 
-	trimmed_string = g_strdup(string);
-	g_strchug(trimmed_string); /* remove possible leading whitespace */
+	trimmed_string = string;
+	while (g_ascii_isspace(*trimmed_string)) /* skip possible leading whitespace */
+		trimmed_string++;
 
 	ft = filetypes[build_info.file_type_id];
 
@@ -1040,8 +1141,16 @@ void msgwin_parse_compiler_error_line(const gchar *string, const gchar *dir,
 		/* fallback to default old-style parsing */
 		parse_compiler_error_line(trimmed_string, filename, line);
 	}
+	if (*filename == NULL)
+		return;
+
+	if (dir == NULL)
+		utf8_dir = utils_get_utf8_from_locale(build_info.dir);
+	else
+		utf8_dir = g_strdup(dir);
+	g_return_if_fail(utf8_dir != NULL);
+
 	make_absolute(filename, utf8_dir);
-	g_free(trimmed_string);
 	g_free(utf8_dir);
 }
 
@@ -1255,10 +1364,12 @@ void msgwin_clear_tab(gint tabnum)
 	switch (tabnum)
 	{
 		case MSG_MESSAGE:
+			clear_pending(pending.msg);
 			store = msgwindow.store_msg;
 			break;
 
 		case MSG_COMPILER:
+			clear_pending(pending.compiler);
 			gtk_list_store_clear(msgwindow.store_compiler);
 			build_menu_update(NULL);	/* update next error items */
 			return;
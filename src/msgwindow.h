@@ -97,6 +97,8 @@ void msgwin_msg_add_string(gint msg_color, gint line, GeanyDocument *doc, const
 
 void msgwin_compiler_add_string(gint msg_color, const gchar *msg);
 
+void msgwin_flush(void);
+
 void msgwin_show_hide_tabs(void);
 
 
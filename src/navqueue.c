@@ -158,6 +158,7 @@ gboolean navqueue_goto_line(GeanyDocument *old_doc, GeanyDocument *new_doc, gint
 	g_return_val_if_fail(DOC_VALID(new_doc), FALSE);
 	g_return_val_if_fail(line >= 1, FALSE);
 
+	document_ensure_loaded(new_doc);
 	pos = sci_get_position_from_line(new_doc->editor->sci, line - 1);
 
 	/* first add old file position */
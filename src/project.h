@@ -58,6 +58,7 @@ typedef struct ProjectPrefs
 	gchar *session_file;
 	gboolean project_session;
 	gboolean project_file_in_basedir;
+	gboolean index_files;
 } ProjectPrefs;
 
 extern ProjectPrefs project_prefs;
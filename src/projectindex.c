@@ -0,0 +1,647 @@
+/*
+ *      projectindex.c - this file is part of Geany, a fast and lightweight IDE
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Project indexer: parses the files under the project base path which match the
+ * project file patterns, so their symbols can be used for autocompletion, calltips
+ * and Go to Symbol without opening them. The files are tracked with file monitors
+ * to keep the index current. Enabled by the index_project_files various pref.
+ *
+ * Files open in documents aren't indexed, the documents provide their symbols.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "projectindex.h"
+
+#include "app.h"
+#include "document.h"
+#include "filetypes.h"
+#include "geanyobject.h"
+#include "project.h"
+#include "utils.h"
+
+#include "tm_source_file.h"
+#include "tm_workspace.h"
+
+#include <string.h>
+#include <gio/gio.h>
+
+
+/* delay before processing file changes, so that a burst of changes (e.g. a
+ * checkout) is processed at once */
+#define CHANGES_DELAY 500
+
+
+/* Scans a directory tree in a worker thread */
+typedef struct
+{
+	gchar *dir;				/* locale encoding */
+	GPatternSpec **patterns;
+	GCancellable *cancellable;
+	GPtrArray *files;		/* locale names of the matching files found */
+	GPtrArray *dirs;		/* locale names of the scanned directories */
+} ScanJob;
+
+/* A file known to the indexer */
+typedef struct
+{
+	TMSourceFile *source_file;
+	gboolean added;			/* whether the source file is in the workspace yet */
+} IndexedFile;
+
+static struct
+{
+	gchar *base_path;		/* locale real path, NULL if not indexing */
+	gchar **patterns;		/* the project file patterns used */
+	GPatternSpec **pattern_specs;
+	GCancellable *cancellable;	/* cancels the running scans and background parsing */
+	GHashTable *files;		/* locale file name -> IndexedFile */
+	GHashTable *monitors;	/* locale directory name -> GFileMonitor */
+	GHashTable *changed;	/* locale file names changed on disk, pending */
+	guint changes_id;
+}
+indexer;
+
+
+static void add_files(GPtrArray *file_names);
+
+
+static gboolean patterns_equal(gchar **a, gchar **b)
+{
+	guint len = a ? g_strv_length(a) : 0;
+	guint i;
+
+	if (len != (b ? g_strv_length(b) : 0))
+		return FALSE;
+	for (i = 0; i < len; i++)
+	{
+		if (! utils_str_equal(a[i], b[i]))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+
+/* hidden files and directories (e.g. VCS data) are never indexed */
+static gboolean is_hidden(const gchar *base_name)
+{
+	return base_name[0] == '.';
+}
+
+
+static void scan_dir(ScanJob *job, const gchar *path)
+{
+	GDir *dir;
+	const gchar *name;
+
+	if (g_cancellable_is_cancelled(job->cancellable))
+		return;
+	dir = g_dir_open(path, 0, NULL);
+	if (! dir)
+		return;
+
+	g_ptr_array_add(job->dirs, g_strdup(path));
+	while ((name = g_dir_read_name(dir)) != NULL)
+	{
+		gchar *file_name;
+
+		if (is_hidden(name))
+			continue;
+
+		file_name = g_build_filename(path, name, NULL);
+		/* don't follow directory links to avoid cycles */
+		if (g_file_test(file_name, G_FILE_TEST_IS_DIR))
+		{
+			if (! g_file_test(file_name, G_FILE_TEST_IS_SYMLINK))
+				scan_dir(job, file_name);
+			g_free(file_name);
+		}
+		/* without patterns all files are candidates, those without a parser are dropped later */
+		else if (utils_match_patterns(job->patterns, name) &&
+			g_file_test(file_name, G_FILE_TEST_IS_REGULAR))
+			g_ptr_array_add(job->files, file_name);
+		else
+			g_free(file_name);
+	}
+	g_dir_close(dir);
+}
+
+
+static void scan_job_free(ScanJob *job)
+{
+	g_free(job->dir);
+	utils_free_patterns(job->patterns);
+	g_object_unref(job->cancellable);
+	g_ptr_array_free(job->files, TRUE);
+	g_ptr_array_free(job->dirs, TRUE);
+	g_slice_free(ScanJob, job);
+}
+
+
+static void on_monitor_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+		GFileMonitorEvent event_type, gpointer user_data);
+
+static void add_monitor(const gchar *dir)
+{
+	GFile *file;
+	GFileMonitor *monitor;
+
+	if (g_hash_table_lookup(indexer.monitors, dir))
+		return;
+
+	file = g_file_new_for_path(dir);
+	monitor = g_file_monitor_directory(file, G_FILE_MONITOR_NONE, NULL, NULL);
+	g_object_unref(file);
+	/* e.g. the system limit of watches is reached, the directory is still indexed */
+	if (! monitor)
+		return;
+
+	g_signal_connect(monitor, "changed", G_CALLBACK(on_monitor_changed), NULL);
+	g_hash_table_insert(indexer.monitors, g_strdup(dir), monitor);
+}
+
+
+static void free_monitor(gpointer data)
+{
+	GFileMonitor *monitor = data;
+
+	g_signal_handlers_disconnect_by_func(monitor, on_monitor_changed, NULL);
+	g_file_monitor_cancel(monitor);
+	g_object_unref(monitor);
+}
+
+
+/* Publishes the results of a scan, runs in the main thread */
+static gboolean scan_job_finish(gpointer data)
+{
+	ScanJob *job = data;
+	guint i;
+
+	/* the project might have been closed meanwhile */
+	if (! g_cancellable_is_cancelled(job->cancellable))
+	{
+		for (i = 0; i < job->dirs->len; i++)
+			add_monitor(job->dirs->pdata[i]);
+		add_files(job->files);
+		geany_debug("Project indexer: found %u files in %u directories of %s",
+			job->files->len, job->dirs->len, job->dir);
+	}
+	scan_job_free(job);
+
+	return FALSE;
+}
+
+
+static gpointer scan_job_run(gpointer data)
+{
+	ScanJob *job = data;
+
+	scan_dir(job, job->dir);
+	g_idle_add(scan_job_finish, job);
+
+	return NULL;
+}
+
+
+static void start_scan(const gchar *dir)
+{
+	ScanJob *job = g_slice_new(ScanJob);
+
+	job->dir = g_strdup(dir);
+	/* GPatternSpec isn't refcounted, each thread gets its own */
+	job->patterns = utils_compile_patterns(indexer.patterns);
+	job->cancellable = g_object_ref(indexer.cancellable);
+	job->files = g_ptr_array_new_with_free_func(g_free);
+	job->dirs = g_ptr_array_new_with_free_func(g_free);
+
+	g_thread_unref(g_thread_new("project-index-scan", scan_job_run, job));
+}
+
+
+static gboolean is_open_in_document(const gchar *locale_file_name)
+{
+	gchar *utf8_file_name = utils_get_utf8_from_locale(locale_file_name);
+	gboolean open = document_find_by_filename(utf8_file_name) != NULL;
+
+	g_free(utf8_file_name);
+	return open;
+}
+
+
+static TMSourceFile *create_source_file(const gchar *locale_file_name)
+{
+	gchar *utf8_file_name = utils_get_utf8_from_locale(locale_file_name);
+	GeanyFiletype *ft = filetypes_detect_from_extension(utf8_file_name);
+	TMSourceFile *source_file = NULL;
+
+	g_free(utf8_file_name);
+	if (filetype_has_tags(ft))
+	{
+		/* lookup the name rather than using filetype name to support custom filetypes */
+		source_file = tm_source_file_new(locale_file_name,
+			tm_source_file_get_lang_name(ft->lang));
+	}
+	return source_file;
+}
+
+
+static void free_indexed_file(gpointer data)
+{
+	IndexedFile *file = data;
+
+	tm_source_file_free(file->source_file);
+	g_slice_free(IndexedFile, file);
+}
+
+
+/* Drops the source files of the files or directory trees matching the
+ predicate from the index and the workspace */
+static void remove_files(gboolean (*predicate)(const gchar *file_name, gpointer data),
+		gpointer data)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	GPtrArray *added = g_ptr_array_new();
+	GPtrArray *removed = g_ptr_array_new_with_free_func(g_free);
+	guint i;
+
+	g_hash_table_iter_init(&iter, indexer.files);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+	{
+		IndexedFile *file = value;
+
+		if (! predicate(key, data))
+			continue;
+		/* source files still parsed in the background are dropped once they
+		 * are added, see on_files_added() */
+		if (file->added)
+			g_ptr_array_add(added, file->source_file);
+		g_ptr_array_add(removed, g_strdup(key));
+	}
+
+	if (added->len > 0)
+		tm_workspace_remove_source_files(added);
+	for (i = 0; i < removed->len; i++)
+		g_hash_table_remove(indexer.files, removed->pdata[i]);
+
+	g_ptr_array_free(added, TRUE);
+	g_ptr_array_free(removed, TRUE);
+}
+
+
+/* Drops a single file from the index and the workspace */
+static void remove_file(const gchar *file_name)
+{
+	IndexedFile *file = g_hash_table_lookup(indexer.files, file_name);
+
+	if (file)
+	{
+		if (file->added)
+			tm_workspace_remove_source_file(file->source_file);
+		g_hash_table_remove(indexer.files, file_name);
+	}
+}
+
+
+static gboolean is_in_dir(const gchar *file_name, gpointer data)
+{
+	const gchar *dir = data;
+	gsize len = strlen(dir);
+
+	return strncmp(file_name, dir, len) == 0 && file_name[len] == G_DIR_SEPARATOR;
+}
+
+
+static gboolean is_monitor_in_dir(gpointer key, gpointer value, gpointer data)
+{
+	return is_in_dir(key, data);
+}
+
+
+static gboolean is_any_file(const gchar *file_name, gpointer data)
+{
+	return TRUE;
+}
+
+
+static gboolean is_file_in_set(const gchar *file_name, gpointer data)
+{
+	return g_hash_table_contains(data, file_name);
+}
+
+
+static void on_files_added(GPtrArray *source_files, gpointer user_data)
+{
+	GPtrArray *stale = g_ptr_array_new();
+	GHashTable *indexed;
+	GHashTableIter iter;
+	gpointer value;
+	guint i;
+
+	/* the index is keyed by file name, find the entries by source file */
+	indexed = g_hash_table_new(g_direct_hash, g_direct_equal);
+	g_hash_table_iter_init(&iter, indexer.files);
+	while (g_hash_table_iter_next(&iter, NULL, &value))
+		g_hash_table_insert(indexed, ((IndexedFile *) value)->source_file, value);
+
+	for (i = 0; i < source_files->len; i++)
+	{
+		IndexedFile *file = g_hash_table_lookup(indexed, source_files->pdata[i]);
+
+		/* removed or changed meanwhile, or opened in a document */
+		if (! file)
+			g_ptr_array_add(stale, source_files->pdata[i]);
+		else
+			file->added = TRUE;
+	}
+	if (stale->len > 0)
+		tm_workspace_remove_source_files(stale);
+
+	g_hash_table_destroy(indexed);
+	g_ptr_array_free(stale, TRUE);
+}
+
+
+/* Indexes the given files, unless they are already indexed or open in a document */
+static void add_files(GPtrArray *file_names)
+{
+	GPtrArray *source_files = g_ptr_array_new();
+	guint i;
+
+	for (i = 0; i < file_names->len; i++)
+	{
+		const gchar *file_name = file_names->pdata[i];
+		IndexedFile *file;
+		TMSourceFile *source_file;
+
+		if (g_hash_table_lookup(indexer.files, file_name) || is_open_in_document(file_name))
+			continue;
+		source_file = create_source_file(file_name);
+		if (! source_file)
+			continue;
+
+		file = g_slice_new(IndexedFile);
+		file->source_file = source_file;
+		file->added = FALSE;
+		g_hash_table_insert(indexer.files, g_strdup(file_name), file);
+		g_ptr_array_add(source_files, source_file);
+	}
+
+	if (source_files->len > 0)
+	{
+		tm_workspace_add_source_files_async(source_files, indexer.cancellable,
+			on_files_added, NULL);
+	}
+	g_ptr_array_free(source_files, TRUE);
+}
+
+
+static gboolean process_changes(gpointer data)
+{
+	GPtrArray *new_files = g_ptr_array_new_with_free_func(g_free);
+	GHashTable *outdated = g_hash_table_new(g_str_hash, g_str_equal);
+	GHashTableIter iter;
+	gpointer key;
+
+	g_hash_table_iter_init(&iter, indexer.changed);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+	{
+		const gchar *file_name = key;
+		IndexedFile *file = g_hash_table_lookup(indexer.files, file_name);
+		gchar *base_name = g_path_get_basename(file_name);
+
+		if (g_file_test(file_name, G_FILE_TEST_IS_DIR))
+		{
+			/* a new directory, possibly moved into the project with its contents */
+			if (! g_hash_table_lookup(indexer.monitors, file_name) &&
+				! g_file_test(file_name, G_FILE_TEST_IS_SYMLINK))
+				start_scan(file_name);
+		}
+		else if (g_file_test(file_name, G_FILE_TEST_IS_REGULAR))
+		{
+			/* changed files are dropped and parsed again in the background like
+			 * new ones, so that many changes (e.g. a checkout) don't block */
+			if (file)
+				g_hash_table_add(outdated, (gpointer) file_name);
+			if (utils_match_patterns(indexer.pattern_specs, base_name))
+				g_ptr_array_add(new_files, g_strdup(file_name));
+		}
+		else if (file)
+			remove_file(file_name);
+		else if (g_hash_table_lookup(indexer.monitors, file_name))
+		{
+			/* a removed directory */
+			remove_files(is_in_dir, (gpointer) file_name);
+			g_hash_table_foreach_remove(indexer.monitors, is_monitor_in_dir, (gpointer) file_name);
+			g_hash_table_remove(indexer.monitors, file_name);
+		}
+		g_free(base_name);
+	}
+
+	if (g_hash_table_size(outdated) > 0)
+		remove_files(is_file_in_set, outdated);
+	g_hash_table_destroy(outdated);
+	g_hash_table_remove_all(indexer.changed);
+
+	add_files(new_files);
+	g_ptr_array_free(new_files, TRUE);
+
+	indexer.changes_id = 0;
+	return FALSE;
+}
+
+
+static void queue_change(const gchar *file_name)
+{
+	gchar *base_name = g_path_get_basename(file_name);
+
+	if (! is_hidden(base_name))
+		g_hash_table_add(indexer.changed, g_strdup(file_name));
+	g_free(base_name);
+
+	if (indexer.changes_id == 0)
+		indexer.changes_id = g_timeout_add(CHANGES_DELAY, process_changes, NULL);
+}
+
+
+static void on_monitor_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+		GFileMonitorEvent event_type, gpointer user_data)
+{
+	gchar *file_name;
+
+	switch (event_type)
+	{
+		case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+		case G_FILE_MONITOR_EVENT_CREATED:
+		case G_FILE_MONITOR_EVENT_DELETED:
+			break;
+		default:
+			return;
+	}
+
+	file_name = g_file_get_path(file);
+	/* documents update their own tags */
+	if (file_name && ! is_open_in_document(file_name))
+		queue_change(file_name);
+	g_free(file_name);
+}
+
+
+static gboolean is_project_file(const gchar *locale_file_name)
+{
+	gchar *base_name;
+	gboolean ret;
+
+	if (! is_in_dir(locale_file_name, indexer.base_path))
+		return FALSE;
+	base_name = g_path_get_basename(locale_file_name);
+	ret = utils_match_patterns(indexer.pattern_specs, base_name);
+	g_free(base_name);
+	return ret;
+}
+
+
+static void on_document_open(GObject *obj, GeanyDocument *doc, gpointer user_data)
+{
+	g_return_if_fail(DOC_VALID(doc));
+
+	/* the document provides the symbols while it's open */
+	if (indexer.base_path && doc->real_path)
+		remove_file(doc->real_path);
+}
+
+
+static void on_document_close(GObject *obj, GeanyDocument *doc, gpointer user_data)
+{
+	g_return_if_fail(DOC_VALID(doc));
+
+	/* index the file again once the document is gone */
+	if (indexer.base_path && doc->real_path && is_project_file(doc->real_path))
+		queue_change(doc->real_path);
+}
+
+
+static void index_stop(void)
+{
+	if (! indexer.base_path)
+		return;
+
+	g_cancellable_cancel(indexer.cancellable);
+	g_object_unref(indexer.cancellable);
+	if (indexer.changes_id != 0)
+		g_source_remove(indexer.changes_id);
+	indexer.changes_id = 0;
+
+	remove_files(is_any_file, NULL);
+	g_hash_table_destroy(indexer.files);
+	g_hash_table_destroy(indexer.monitors);
+	g_hash_table_destroy(indexer.changed);
+	utils_free_patterns(indexer.pattern_specs);
+	g_strfreev(indexer.patterns);
+	g_free(indexer.base_path);
+	indexer.base_path = NULL;
+}
+
+
+static void index_start(void)
+{
+	gchar *utf8_base_path = project_get_base_path();
+	gchar *locale_base_path;
+
+	if (! utf8_base_path)
+		return;
+	locale_base_path = utils_get_locale_from_utf8(utf8_base_path);
+	g_free(utf8_base_path);
+
+	/* the real path so that the scanned names match the real paths of documents */
+	indexer.base_path = tm_get_real_path(locale_base_path);
+	g_free(locale_base_path);
+	if (! indexer.base_path || ! g_file_test(indexer.base_path, G_FILE_TEST_IS_DIR))
+	{
+		g_free(indexer.base_path);
+		indexer.base_path = NULL;
+		return;
+	}
+
+	indexer.patterns = g_strdupv(app->project->file_patterns);
+	indexer.pattern_specs = utils_compile_patterns(indexer.patterns);
+	indexer.cancellable = g_cancellable_new();
+	indexer.files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_indexed_file);
+	indexer.monitors = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_monitor);
+	indexer.changed = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	start_scan(indexer.base_path);
+}
+
+
+static void on_project_open(GObject *obj, GKeyFile *config, gpointer user_data)
+{
+	if (project_prefs.index_files)
+		index_start();
+}
+
+
+static void on_project_save(GObject *obj, GKeyFile *config, gpointer user_data)
+{
+	gchar *utf8_base_path, *locale_base_path, *base_path;
+	gboolean changed;
+
+	if (! project_prefs.index_files)
+		return;
+
+	/* restart if the project properties changed what is indexed */
+	utf8_base_path = project_get_base_path();
+	locale_base_path = utils_get_locale_from_utf8(utf8_base_path);
+	base_path = tm_get_real_path(locale_base_path);
+	changed = ! utils_str_equal(base_path, indexer.base_path) ||
+		! patterns_equal(app->project->file_patterns, indexer.patterns);
+	g_free(base_path);
+	g_free(locale_base_path);
+	g_free(utf8_base_path);
+
+	if (changed)
+	{
+		index_stop();
+		index_start();
+	}
+}
+
+
+static void on_project_before_close(GObject *obj, gpointer user_data)
+{
+	index_stop();
+}
+
+
+void project_index_init(void)
+{
+	g_signal_connect(geany_object, "project-open", G_CALLBACK(on_project_open), NULL);
+	g_signal_connect(geany_object, "project-save", G_CALLBACK(on_project_save), NULL);
+	g_signal_connect(geany_object, "project-before-close", G_CALLBACK(on_project_before_close), NULL);
+	g_signal_connect(geany_object, "document-open", G_CALLBACK(on_document_open), NULL);
+	g_signal_connect(geany_object, "document-close", G_CALLBACK(on_document_close), NULL);
+}
+
+
+void project_index_finalize(void)
+{
+	index_stop();
+}
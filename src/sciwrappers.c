@@ -743,6 +743,26 @@ void sci_colourise(ScintillaObject *sci, gint start, gint end)
 }
 
 
+/* Styles the text up to pos unless it is already. Scintilla only styles the text it
+ * draws (and the rest when idle), so use this before relying on the styles or fold
+ * levels of text which might not have been drawn yet.
+ * @param pos The position to style up to, or -1 for the end of the document. */
+void sci_ensure_styled(ScintillaObject *sci, gint pos)
+{
+	gint end_styled = sci_get_end_styled(sci);
+
+	if (pos == -1)
+		pos = sci_get_length(sci);
+	if (end_styled < pos)
+	{
+		/* like Scintilla, restart styling at the beginning of the line */
+		gint start = sci_get_position_from_line(sci, sci_get_line_from_position(sci, end_styled));
+
+		sci_colourise(sci, start, pos);
+	}
+}
+
+
 void sci_clear_all(ScintillaObject *sci)
 {
 	SSM(sci, SCI_CLEARALL, 0, 0);
@@ -1101,6 +1121,23 @@ gint sci_get_first_visible_line(ScintillaObject *sci)
 }
 
 
+/* Gets the range of the document lines shown in the view, from the start of the first
+ * line to the start of the line after the last one or the end of the document */
+void sci_get_visible_range(ScintillaObject *sci, gint *start, gint *end)
+{
+	gint first_visible = sci_get_first_visible_line(sci);
+	gint first_line = (gint) SSM(sci, SCI_DOCLINEFROMVISIBLE, (uptr_t) first_visible, 0);
+	gint last_line = (gint) SSM(sci, SCI_DOCLINEFROMVISIBLE,
+		(uptr_t) (first_visible + SSM(sci, SCI_LINESONSCREEN, 0, 0)), 0);
+
+	*start = sci_get_position_from_line(sci, first_line);
+	if (last_line + 1 >= sci_get_line_count(sci))
+		*end = sci_get_length(sci);
+	else
+		*end = sci_get_position_from_line(sci, last_line + 1);
+}
+
+
 /**
  *  Sets the current indicator. This is necessary to define an indicator for a range of text or
  *  clearing indicators for a range of text.
@@ -152,6 +152,7 @@ void 				sci_set_folding_margin_visible (ScintillaObject *sci, gboolean set);
 gboolean			sci_get_fold_expanded		(ScintillaObject *sci, gint line);
 
 void				sci_colourise				(ScintillaObject *sci, gint start, gint end);
+void				sci_ensure_styled			(ScintillaObject *sci, gint pos);
 void				sci_clear_all				(ScintillaObject *sci);
 gint				sci_get_end_styled			(ScintillaObject *sci);
 void				sci_set_tab_width			(ScintillaObject *sci, gint width);
@@ -178,6 +179,7 @@ void				sci_set_readonly			(ScintillaObject *sci, gboolean readonly);
 
 gint				sci_get_lines_selected		(ScintillaObject *sci);
 gint				sci_get_first_visible_line	(ScintillaObject *sci);
+void				sci_get_visible_range		(ScintillaObject *sci, gint *start, gint *end);
 
 void				sci_indicator_fill			(ScintillaObject *sci, gint pos, gint len);
 
@@ -32,8 +32,10 @@
 
 #include "app.h"
 #include "document.h"
+#include "documentprivate.h"
 #include "encodings.h"
 #include "encodingsprivate.h"
+#include "findinfiles.h"
 #include "keyfile.h"
 #include "msgwindow.h"
 #include "prefs.h"
@@ -157,6 +159,9 @@ static gchar **search_get_argv(const gchar **argv_prefix, const gchar *dir);
 
 static GRegex *compile_regex(const gchar *str, GeanyFindFlags sflags);
 
+static gint find_text_regex(ScintillaObject *sci, GRegex *regex, GeanyFindFlags flags,
+		struct Sci_TextToFind *ttf, GeanyMatchInfo **match_);
+
 
 static void
 on_find_replace_checkbutton_toggled(GtkToggleButton *togglebutton, gpointer user_data);
@@ -179,6 +184,47 @@ on_replace_find_entry_activate(GtkEntry *entry, gpointer user_data);
 static void
 on_replace_entry_activate(GtkEntry *entry, gpointer user_data);
 
+static gboolean fif_uses_extra_options(void)
+{
+	if (! settings.fif_use_extra_options)
+		return FALSE;
+
+	g_strstrip(settings.fif_extra_options);
+	return *settings.fif_extra_options != 0;
+}
+
+
+/* Whether to search with the grep tool rather than the built-in search: only grep
+ * understands the extra options, and a grep tool set by the user is respected */
+static gboolean fif_uses_grep(void)
+{
+	return fif_uses_extra_options() ||
+		! utils_str_equal(tool_prefs.grep_cmd, GEANY_DEFAULT_TOOLS_GREP);
+}
+
+
+static gboolean search_find_in_files_builtin(const gchar *utf8_search_text, const gchar *utf8_dir,
+	const gchar *enc)
+{
+	GeanyFindFlags flags = 0;
+	const gchar *patterns = NULL;
+
+	if (settings.fif_regexp)
+		flags |= GEANY_FIND_REGEXP;
+	if (settings.fif_case_sensitive)
+		flags |= GEANY_FIND_MATCHCASE;
+	if (settings.fif_match_whole_word)
+		flags |= GEANY_FIND_WHOLEWORD;
+
+	g_strstrip(settings.fif_files);
+	if (settings.fif_files_mode != FILES_MODE_ALL && *settings.fif_files)
+		patterns = settings.fif_files;
+
+	return find_in_files_start(utf8_search_text, utf8_dir, flags, settings.fif_invert_results,
+		settings.fif_recursive, patterns, enc);
+}
+
+
 static void
 on_find_in_files_dialog_response(GtkDialog *dialog, gint response, gpointer user_data);
 
@@ -291,6 +337,7 @@ void search_finalize(void)
 	FREE_WIDGET(fif_dlg.dialog);
 	g_free(search_data.text);
 	g_free(search_data.original_text);
+	find_in_files_finalize();
 }
 
 
@@ -1196,12 +1243,22 @@ static GSList *find_range(ScintillaObject *sci, GeanyFindFlags flags, struct Sci
 {
 	GSList *matches = NULL;
 	GeanyMatchInfo *info;
+	GRegex *regex = NULL;
 
 	g_return_val_if_fail(sci != NULL && ttf->lpstrText != NULL, NULL);
 	if (! *ttf->lpstrText)
 		return NULL;
 
-	while (search_find_text(sci, flags, ttf, &info) != -1)
+	/* compile the regex once for all the matches */
+	if (flags & GEANY_FIND_REGEXP)
+	{
+		regex = compile_regex(ttf->lpstrText, flags);
+		if (! regex)
+			return NULL;
+	}
+
+	while ((regex ? find_text_regex(sci, regex, flags, ttf, &info) :
+		search_find_text(sci, flags, ttf, &info)) != -1)
 	{
 		if (ttf->chrgText.cpMax > ttf->chrg.cpMax)
 		{
@@ -1219,45 +1276,287 @@ static GSList *find_range(ScintillaObject *sci, GeanyFindFlags flags, struct Sci
 		if (ttf->chrgText.cpMax == ttf->chrgText.cpMin)
 			ttf->chrg.cpMin ++;
 	}
+	if (regex)
+		g_regex_unref(regex);
 
 	return g_slist_reverse(matches);
 }
 
 
-/* Clears markers if text is null/empty.
- * @return Number of matches marked. */
-gint search_mark_all(GeanyDocument *doc, const gchar *search_text, GeanyFindFlags flags)
+/* Mark All marks the matches in the visible text at once and the rest of the document in
+ * idle time, so marking doesn't block on large documents. The marks are kept up to date
+ * while the document is edited by marking the changed lines again, until they are cleared.
+ * The pending ranges are the (at most two) ranges of the first pass, followed by a single
+ * range spanning the edits not marked again yet. */
+
+/* how much text to mark at once and for how long, before checking for events again */
+#define MARK_ALL_CHUNK_SIZE 65536
+#define MARK_ALL_TIME_SLICE 10000 /* microseconds */
+
+typedef struct
 {
-	gint count = 0;
+	gint start, end;
+	gboolean initial;	/* part of the first pass, whose matches are counted */
+}
+MarkAllRange;
+
+typedef struct MarkAllSearch
+{
+	GeanyDocument *doc;
+	gchar *text;
+	GeanyFindFlags flags;
+	GRegex *regex;			/* NULL unless (flags & GEANY_FIND_REGEXP) */
+	GArray *pending;		/* MarkAllRange's still to (re)mark, in order */
+	gint count;				/* number of matches found so far by the first pass */
+	gchar *report_text;		/* text to report the count for when done, or NULL */
+	guint source_id;
+}
+MarkAllSearch;
+
+
+static void mark_all_free(MarkAllSearch *search)
+{
+	if (search->source_id)
+		g_source_remove(search->source_id);
+	if (search->regex)
+		g_regex_unref(search->regex);
+	g_array_free(search->pending, TRUE);
+	g_free(search->report_text);
+	g_free(search->text);
+	g_free(search);
+}
+
+
+/* Stops keeping the Mark All matches of doc up to date, without clearing the marks */
+void search_mark_all_stop(GeanyDocument *doc)
+{
+	if (doc->priv->mark_all)
+	{
+		mark_all_free(doc->priv->mark_all);
+		doc->priv->mark_all = NULL;
+	}
+}
+
+
+static gboolean is_marked(ScintillaObject *sci, gint pos)
+{
+	return scintilla_send_message(sci, SCI_INDICATORVALUEAT, GEANY_INDICATOR_SEARCH, pos) != 0;
+}
+
+
+/* Marks the matches starting within the lines from start to end and removes stale marks.
+ * Chunks end at line starts, so only multiline matches can cross them. The marks crossing
+ * start or end are cleared and their matches marked again as a whole, as they might come
+ * from a match that started in another chunk or that the text was edited out of.
+ * count tells whether to count the matches, which is only done by the first pass as
+ * edited lines are marked again. */
+static void mark_all_range(MarkAllSearch *search, gint start, gint end, gboolean count)
+{
+	ScintillaObject *sci = search->doc->editor->sci;
 	struct Sci_TextToFind ttf;
-	GSList *match, *matches;
+	gint length = sci_get_length(sci);
+	gint clear_start = start, clear_end = end;
+
+	if (start > 0 && start < length && is_marked(sci, start - 1) && is_marked(sci, start))
+		clear_start = (gint) scintilla_send_message(sci, SCI_INDICATORSTART,
+			GEANY_INDICATOR_SEARCH, start - 1);
+	if (end > 0 && end < length && is_marked(sci, end - 1) && is_marked(sci, end))
+		clear_end = (gint) scintilla_send_message(sci, SCI_INDICATOREND,
+			GEANY_INDICATOR_SEARCH, end);
+
+	sci_indicator_set(sci, GEANY_INDICATOR_SEARCH);
+	sci_indicator_clear(sci, clear_start, clear_end - clear_start);
+
+	ttf.chrg.cpMin = clear_start;
+	/* let matches starting in the range end after it */
+	ttf.chrg.cpMax = search->regex ? clear_end :
+		MIN(clear_end + (gint) strlen(search->text), length);
+	ttf.lpstrText = search->text;
+
+	while (ttf.chrg.cpMin <= ttf.chrg.cpMax &&
+		(search->regex ? find_text_regex(sci, search->regex, search->flags, &ttf, NULL) :
+			search_find_text(sci, search->flags, &ttf, NULL)) != -1 &&
+		ttf.chrgText.cpMin < clear_end)
+	{
+		if (ttf.chrgText.cpMax > ttf.chrgText.cpMin)
+			editor_indicator_set_on_range(search->doc->editor, GEANY_INDICATOR_SEARCH,
+				ttf.chrgText.cpMin, ttf.chrgText.cpMax);
+		/* the matches outside of the range are counted by their own chunk */
+		if (count && ttf.chrgText.cpMin >= start && ttf.chrgText.cpMin < end)
+			search->count++;
+
+		ttf.chrg.cpMin = ttf.chrgText.cpMax;
+		/* avoid rematching with empty matches, see find_range() */
+		if (ttf.chrgText.cpMax == ttf.chrgText.cpMin)
+			ttf.chrg.cpMin++;
+	}
+}
 
-	g_return_val_if_fail(DOC_VALID(doc), 0);
+
+/* Marks the next chunk of the first pending range, returns FALSE if nothing is left */
+static gboolean mark_all_next_chunk(MarkAllSearch *search)
+{
+	ScintillaObject *sci = search->doc->editor->sci;
+	MarkAllRange *range;
+	gint start, end;
+
+	if (search->pending->len == 0)
+		return FALSE;
+
+	range = &g_array_index(search->pending, MarkAllRange, 0);
+	start = sci_get_position_from_line(sci, sci_get_line_from_position(sci, range->start));
+	end = MIN(range->end, range->start + MARK_ALL_CHUNK_SIZE);
+	end = sci_get_position_from_line(sci, sci_get_line_from_position(sci, end) + 1);
+	if (end <= start)
+		end = sci_get_length(sci);
+
+	mark_all_range(search, start, end, range->initial);
+
+	if (end >= range->end || end >= sci_get_length(sci))
+		g_array_remove_index(search->pending, 0);
+	else
+		range->start = end;
+	return search->pending->len > 0;
+}
+
+
+static void mark_all_report(MarkAllSearch *search)
+{
+	if (search->count == 0)
+		ui_set_statusbar(FALSE, _("No matches found for \"%s\"."), search->report_text);
+	else
+		ui_set_statusbar(FALSE,
+			ngettext("Found %d match for \"%s\".",
+					 "Found %d matches for \"%s\".", search->count),
+			search->count, search->report_text);
+	SETPTR(search->report_text, NULL);
+}
+
+
+static gboolean mark_all_idle(gpointer data)
+{
+	MarkAllSearch *search = data;
+	gint64 deadline = g_get_monotonic_time() + MARK_ALL_TIME_SLICE;
+
+	while (mark_all_next_chunk(search))
+	{
+		if (g_get_monotonic_time() >= deadline)
+			return TRUE;
+	}
+
+	if (search->report_text)
+		mark_all_report(search);
+	search->source_id = 0;
+	return FALSE;
+}
+
+
+static void mark_all_queue(MarkAllSearch *search, gint start, gint end, gboolean initial)
+{
+	MarkAllRange range = { start, end, initial };
+
+	if (search->pending->len > 0)
+	{
+		MarkAllRange *last = &g_array_index(search->pending, MarkAllRange,
+			search->pending->len - 1);
+
+		/* Edits all go into a single range after the initial ones, so bulk edits like
+		 * replacing many separate matches don't make a range each. Initial ranges are
+		 * only merged when they overlap. */
+		if (initial == last->initial &&
+			(! initial || (start <= last->end && end >= last->start)))
+		{
+			last->start = MIN(last->start, start);
+			last->end = MAX(last->end, end);
+			range.start = range.end = -1;
+		}
+	}
+	if (range.start >= 0 && range.end > range.start)
+		g_array_append_val(search->pending, range);
+
+	if (search->pending->len > 0 && ! search->source_id)
+		search->source_id = g_idle_add(mark_all_idle, search);
+}
+
+
+static gint adjust_position(gint pos, gint mod_pos, gint delta)
+{
+	if (delta > 0 && pos > mod_pos)
+		return pos + delta;
+	if (delta < 0 && pos > mod_pos)
+		return MAX(pos + delta, mod_pos);
+	return pos;
+}
+
+
+/* Called when text was inserted (length > 0) or deleted (length < 0) at pos */
+void search_mark_all_text_changed(GeanyDocument *doc, gint pos, gint length)
+{
+	MarkAllSearch *search = doc->priv->mark_all;
+	guint i;
+
+	if (! search)
+		return;
+
+	for (i = 0; i < search->pending->len; i++)
+	{
+		MarkAllRange *range = &g_array_index(search->pending, MarkAllRange, i);
+
+		range->start = adjust_position(range->start, pos, length);
+		range->end = adjust_position(range->end, pos, length);
+	}
+	mark_all_queue(search, pos, pos + MAX(length, 0) + 1, FALSE);
+}
+
+
+/* Marks all matches of search_text in doc, the visible ones at once and the others in
+ * idle time. Clears the marks if search_text is NULL or empty.
+ * If report_text isn't NULL, the number of matches found for it is shown in the status
+ * bar once all matches are marked. */
+void search_mark_all(GeanyDocument *doc, const gchar *search_text, GeanyFindFlags flags,
+		const gchar *report_text)
+{
+	MarkAllSearch *search;
+	ScintillaObject *sci;
+	gint visible_start, visible_end;
+
+	g_return_if_fail(DOC_VALID(doc));
+
+	search_mark_all_stop(doc);
 
 	/* clear previous search indicators */
 	editor_indicator_clear(doc->editor, GEANY_INDICATOR_SEARCH);
 
 	if (G_UNLIKELY(EMPTY(search_text)))
-		return 0;
-
-	ttf.chrg.cpMin = 0;
-	ttf.chrg.cpMax = sci_get_length(doc->editor->sci);
-	ttf.lpstrText = (gchar *)search_text;
+		return;
 
-	matches = find_range(doc->editor->sci, flags, &ttf);
-	foreach_slist (match, matches)
+	search = g_new0(MarkAllSearch, 1);
+	search->doc = doc;
+	search->text = g_strdup(search_text);
+	search->flags = flags;
+	search->report_text = g_strdup(report_text);
+	search->pending = g_array_new(FALSE, FALSE, sizeof(MarkAllRange));
+	if (flags & GEANY_FIND_REGEXP)
 	{
-		GeanyMatchInfo *info = match->data;
+		search->regex = compile_regex(search_text, flags);
+		if (! search->regex)
+		{
+			mark_all_free(search);
+			return;
+		}
+	}
+	doc->priv->mark_all = search;
 
-		if (info->end != info->start)
-			editor_indicator_set_on_range(doc->editor, GEANY_INDICATOR_SEARCH, info->start, info->end);
-		count++;
+	sci = doc->editor->sci;
+	sci_get_visible_range(sci, &visible_start, &visible_end);
 
-		geany_match_info_free(info);
-	}
-	g_slist_free(matches);
+	/* mark the visible text first, then the text after and before it */
+	mark_all_range(search, visible_start, visible_end, TRUE);
+	mark_all_queue(search, visible_end, sci_get_length(sci), TRUE);
+	mark_all_queue(search, 0, visible_start, TRUE);
 
-	return count;
+	if (search->pending->len == 0 && search->report_text)
+		mark_all_report(search);
 }
 
 
@@ -1361,18 +1660,8 @@ on_find_dialog_response(GtkDialog *dialog, gint response, gpointer user_data)
 				break;
 
 			case GEANY_RESPONSE_MARK:
-			{
-				gint count = search_mark_all(doc, search_data.text, search_data.flags);
-
-				if (count == 0)
-					ui_set_statusbar(FALSE, _("No matches found for \"%s\"."), search_data.original_text);
-				else
-					ui_set_statusbar(FALSE,
-						ngettext("Found %d match for \"%s\".",
-								 "Found %d matches for \"%s\".", count),
-						count, search_data.original_text);
-			}
-			break;
+				search_mark_all(doc, search_data.text, search_data.flags, search_data.original_text);
+				break;
 		}
 		if (check_close)
 			gtk_widget_hide(find_dlg.dialog);
@@ -1616,18 +1905,26 @@ on_find_in_files_dialog_response(GtkDialog *dialog, gint response,
 			ui_set_statusbar(FALSE, _("Invalid directory for find in files."));
 		else if (!EMPTY(search_text))
 		{
-			GString *opts = get_grep_options();
 			const gchar *enc = (enc_idx == GEANY_ENCODING_UTF_8) ? NULL :
 				encodings_get_charset_from_index(enc_idx);
+			gboolean started;
 
-			if (search_find_in_files(search_text, utf8_dir, opts->str, enc))
+			if (! fif_uses_grep())
+				started = search_find_in_files_builtin(search_text, utf8_dir, enc);
+			else
+			{
+				GString *opts = get_grep_options();
+
+				started = search_find_in_files(search_text, utf8_dir, opts->str, enc);
+				g_string_free(opts, TRUE);
+			}
+			if (started)
 			{
 				ui_combo_box_add_to_history(GTK_COMBO_BOX_TEXT(search_combo), search_text, 0);
 				ui_combo_box_add_to_history(GTK_COMBO_BOX_TEXT(fif_dlg.files_combo), NULL, 0);
 				ui_combo_box_add_to_history(GTK_COMBO_BOX_TEXT(dir_combo), utf8_dir, 0);
 				gtk_widget_hide(fif_dlg.dialog);
 			}
-			g_string_free(opts, TRUE);
 		}
 		else
 			ui_set_statusbar(FALSE, _("No text to find."));
@@ -1695,7 +1992,7 @@ search_find_in_files(const gchar *utf8_search_text, const gchar *utf8_dir, const
 		}
 	}
 
-	gtk_list_store_clear(msgwindow.store_msg);
+	msgwin_clear_tab(MSG_MESSAGE);
 	gtk_notebook_set_current_page(GTK_NOTEBOOK(msgwindow.notebook), MSG_MESSAGE);
 
 	/* we can pass 'enc' without strdup'ing it here because it's a global const string and
@@ -1867,9 +2164,13 @@ static void search_finished(GPid child_pid, gint status, gpointer user_data)
 	{
 		case 0:
 		{
-			gint count = gtk_tree_model_iter_n_children(
+			gint count;
+			gchar *text;
+
+			msgwin_flush();
+			count = gtk_tree_model_iter_n_children(
 				GTK_TREE_MODEL(msgwindow.store_msg), NULL) - 1;
-			gchar *text = ngettext(
+			text = ngettext(
 						"Search completed with %d match.",
 						"Search completed with %d matches.", count);
 
@@ -1893,7 +2194,8 @@ static GRegex *compile_regex(const gchar *str, GeanyFindFlags sflags)
 {
 	GRegex *regex;
 	GError *error = NULL;
-	gint rflags = 0;
+	/* the regex is usually matched many times, e.g. against every line */
+	gint rflags = G_REGEX_OPTIMIZE;
 
 	if (sflags & GEANY_FIND_MULTILINE)
 		rflags |= G_REGEX_MULTILINE;
@@ -1914,64 +2216,142 @@ static GRegex *compile_regex(const gchar *str, GeanyFindFlags sflags)
 }
 
 
-/* groups that don't exist are handled OK as len = end - start = (-1) - (-1) = 0 */
-static gchar *get_regex_match_string(const gchar *text, const GeanyMatchInfo *match, guint nth)
+/* Gets the whole document text, moving the smaller part of the gap buffer out of the way.
+ * Warning: any SCI calls will invalidate the returned text */
+static const gchar *get_document_text(ScintillaObject *sci, gint length)
+{
+	gint gap = (gint) scintilla_send_message(sci, SCI_GETGAPPOSITION, 0, 0);
+
+	/* moves the gap to the start, i.e. the text before the gap */
+	if (gap < length / 2)
+		return (void*)scintilla_send_message(sci, SCI_GETRANGEPOINTER, 0, length);
+	/* moves the gap to the end, i.e. the text after the gap */
+	return (void*)scintilla_send_message(sci, SCI_GETCHARACTERPOINTER, 0, 0);
+}
+
+
+/* Matches regex against each line of text, which starts at the document position text_pos
+ * and at a line start. doc_end tells whether text ends at the end of the document, so
+ * its empty last line is matched as well. Only lines starting before limit are matched.
+ * Returns the position of the matching line, or -1 and sets *minfo to NULL. */
+static gint match_lines(GRegex *regex, const gchar *text, gint length, gint text_pos,
+		gboolean doc_end, gint pos, gint limit, GMatchInfo **minfo)
 {
-	const gint start = match->matches[nth].start;
-	const gint end = match->matches[nth].end;
-	return g_strndup(&text[start], end - start);
+	const gchar *text_end = text + length;
+	const gchar *line = text;
+
+	while (line < text_end || (doc_end && line == text_end))
+	{
+		const gchar *eol = line;
+		gint offset = text_pos + (gint) (line - text);
+
+		if (offset >= limit)
+			break;
+		while (eol < text_end && *eol != '\n' && *eol != '\r')
+			eol++;
+
+		if (g_regex_match_full(regex, line, eol - line, MAX(pos - offset, 0), 0, minfo, NULL))
+			return offset;
+		g_match_info_free(*minfo);
+
+		/* not found, try next line */
+		if (eol == text_end)
+			break;
+		if (*eol == '\r' && eol + 1 < text_end && eol[1] == '\n')
+			eol++;
+		line = eol + 1;
+	}
+	*minfo = NULL;
+	return -1;
 }
 
 
-static gint find_regex(ScintillaObject *sci, guint pos, GRegex *regex, gboolean multiline, GeanyMatchInfo *match)
+/* Finds the first match of regex starting from pos and before limit, or -1 for no limit.
+ * The text after limit is only searched for matches that continue after it. */
+static gint find_regex(ScintillaObject *sci, guint pos, gint limit, GRegex *regex, gboolean multiline,
+		GeanyMatchInfo *match)
 {
 	const gchar *text;
-	GMatchInfo *minfo;
-	guint document_length;
+	GMatchInfo *minfo = NULL;
+	gint document_length;
 	gint ret = -1;
 	gint offset = 0;
 
-	document_length = (guint)sci_get_length(sci);
+	document_length = sci_get_length(sci);
 	if (document_length <= 0)
 		return -1; /* skip empty documents */
 
-	g_return_val_if_fail(pos <= document_length, -1);
+	g_return_val_if_fail(pos <= (guint) document_length, -1);
+
+	/* an empty match can start at the end of the document */
+	if (limit < 0 || limit > document_length)
+		limit = document_length + 1;
+	if ((gint) pos >= limit)
+		return -1;
 
 	if (multiline)
 	{
-		/* Warning: any SCI calls will invalidate 'text' after calling SCI_GETCHARACTERPOINTER */
-		text = (void*)scintilla_send_message(sci, SCI_GETCHARACTERPOINTER, 0, 0);
-		g_regex_match_full(regex, text, -1, pos, 0, &minfo, NULL);
-	}
-	else /* single-line mode, manually match against each line */
-	{
-		gint line = sci_get_line_from_position(sci, pos);
+		gint length = document_length;
+		GRegexMatchFlags mflags = 0;
 
-		for (;;)
+		text = get_document_text(sci, document_length);
+#if GLIB_CHECK_VERSION(2, 34, 0)
+		/* Match up to limit, and again against the whole text if a match might continue
+		 * after it. A partial match is returned as soon as the end is hit, so a match
+		 * starting before it isn't skipped for a complete one starting later. */
+		if (limit < document_length)
 		{
-			gint start = sci_get_position_from_line(sci, line);
-			gint end = sci_get_line_end_position(sci, line);
+			length = limit;
+			mflags = G_REGEX_MATCH_PARTIAL_HARD;
+		}
+#endif
+		g_regex_match_full(regex, text, length, pos, mflags, &minfo, NULL);
+		if (length < document_length)
+		{
+			gint start = -1, end = -1;
 
-			text = (void*)scintilla_send_message(sci, SCI_GETRANGEPOINTER, start, end - start);
-			if (g_regex_match_full(regex, text, end - start, pos - start, 0, &minfo, NULL))
+			if (g_match_info_is_partial_match(minfo) || g_match_info_matches(minfo))
+				g_match_info_fetch_pos(minfo, 0, &start, &end);
+			if (end == length)
 			{
-				offset = start;
-				break;
-			}
-			else /* not found, try next line */
-			{
-				line ++;
-				if (line >= sci_get_line_count(sci))
-					break;
-				pos = sci_get_position_from_line(sci, line);
-				/* don't free last info, it's freed below */
 				g_match_info_free(minfo);
+				g_regex_match_full(regex, text, document_length, start, 0, &minfo, NULL);
 			}
 		}
 	}
+	else /* single-line mode, manually match against each line */
+	{
+		gint text_start = sci_get_position_from_line(sci, sci_get_line_from_position(sci, pos));
+		gint text_end = MIN(limit, document_length);
+		gint gap = (gint) scintilla_send_message(sci, SCI_GETGAPPOSITION, 0, 0);
+		gint split;
+
+		/* up to the end of the line of limit, to match the lines starting before it */
+		text_end = sci_get_line_end_position(sci, sci_get_line_from_position(sci, text_end));
+
+		/* Split the lines at the start of the line containing the gap, so getting the
+		 * lines before it doesn't move the gap and getting the others only moves it
+		 * to the start of that line. Warning: any SCI calls will invalidate 'text' */
+		split = sci_get_position_from_line(sci, sci_get_line_from_position(sci, gap));
+		split = CLAMP(split, text_start, text_end);
+		if (split > text_start)
+		{
+			text = (void*)scintilla_send_message(sci, SCI_GETRANGEPOINTER,
+				text_start, split - text_start);
+			offset = match_lines(regex, text, split - text_start, text_start,
+				FALSE, pos, limit, &minfo);
+		}
+		if (! minfo && split < limit && (split < text_end || text_end == document_length))
+		{
+			text = (void*)scintilla_send_message(sci, SCI_GETRANGEPOINTER,
+				split, text_end - split);
+			offset = match_lines(regex, text, text_end - split, split,
+				text_end == document_length, pos, limit, &minfo);
+		}
+	}
 
 	/* Warning: minfo will become invalid when 'text' does! */
-	if (g_match_info_matches(minfo))
+	if (minfo && g_match_info_matches(minfo))
 	{
 		guint i;
 
@@ -1988,9 +2368,11 @@ static gint find_regex(ScintillaObject *sci, guint pos, GRegex *regex, gboolean
 		}
 		match->start = match->matches[0].start;
 		match->end = match->matches[0].end;
-		ret = match->start;
+		if (match->start < limit)
+			ret = match->start;
 	}
-	g_match_info_free(minfo);
+	if (minfo)
+		g_match_info_free(minfo);
 	return ret;
 }
 
@@ -2041,10 +2423,10 @@ gint search_find_next(ScintillaObject *sci, const gchar *str, GeanyFindFlags fla
 	match = match_info_new(flags, 0, 0);
 
 	pos = sci_get_current_position(sci);
-	ret = find_regex(sci, pos, regex, flags & GEANY_FIND_MULTILINE, match);
+	ret = find_regex(sci, pos, -1, regex, flags & GEANY_FIND_MULTILINE, match);
 	/* avoid re-matching the same position in case of empty matches */
 	if (ret == pos && match->matches[0].start == match->matches[0].end)
-		ret = find_regex(sci, pos + 1, regex, flags & GEANY_FIND_MULTILINE, match);
+		ret = find_regex(sci, pos + 1, -1, regex, flags & GEANY_FIND_MULTILINE, match);
 	if (ret >= 0)
 		sci_set_selection(sci, match->start, match->end);
 
@@ -2058,46 +2440,60 @@ gint search_find_next(ScintillaObject *sci, const gchar *str, GeanyFindFlags fla
 }
 
 
-gint search_replace_match(ScintillaObject *sci, const GeanyMatchInfo *match, const gchar *replace_text)
+/* Appends the replacement of match to str, expanding the \0 - \9 back references
+ * for regular expressions */
+static void append_replacement(GString *str, const GeanyMatchInfo *match, const gchar *replace_text)
 {
-	GString *str;
-	gint ret = 0;
-	gint i = 0;
-
-	sci_set_target_start(sci, match->start);
-	sci_set_target_end(sci, match->end);
+	const gchar *p;
 
 	if (! (match->flags & GEANY_FIND_REGEXP))
-		return sci_replace_target(sci, replace_text, FALSE);
+	{
+		g_string_append(str, replace_text);
+		return;
+	}
 
-	str = g_string_new(replace_text);
-	while (str->str[i])
+	for (p = replace_text; *p; p++)
 	{
-		gchar *ptr = &str->str[i];
-		gchar *grp;
-		gchar c;
+		gint nth, start, end;
 
-		if (ptr[0] != '\\')
+		if (*p != '\\')
 		{
-			i++;
+			g_string_append_c(str, *p);
 			continue;
 		}
-		c = ptr[1];
+		p++;
+		if (! *p)
+			break;
 		/* backslash or unnecessary escape */
-		if (c == '\\' || !isdigit(c))
+		if (! isdigit(*p))
 		{
-			g_string_erase(str, i, 1);
-			i++;
+			g_string_append_c(str, *p);
 			continue;
 		}
-		/* digit escape */
-		g_string_erase(str, i, 2);
-		/* fix match offsets by subtracting index of whole match start from the string */
-		grp = get_regex_match_string(match->match_text - match->matches[0].start, match, c - '0');
-		g_string_insert(str, i, grp);
-		i += strlen(grp);
-		g_free(grp);
+		/* digit escape, groups that don't exist are empty */
+		nth = *p - '0';
+		start = match->matches[nth].start;
+		end = match->matches[nth].end;
+		/* only the text of the whole match is kept */
+		if (start >= match->matches[0].start && end <= match->matches[0].end && start < end)
+			g_string_append_len(str, match->match_text + (start - match->matches[0].start), end - start);
 	}
+}
+
+
+gint search_replace_match(ScintillaObject *sci, const GeanyMatchInfo *match, const gchar *replace_text)
+{
+	GString *str;
+	gint ret;
+
+	sci_set_target_start(sci, match->start);
+	sci_set_target_end(sci, match->end);
+
+	if (! (match->flags & GEANY_FIND_REGEXP))
+		return sci_replace_target(sci, replace_text, FALSE);
+
+	str = g_string_new(NULL);
+	append_replacement(str, match, replace_text);
 	ret = sci_replace_target(sci, str->str, FALSE);
 	g_string_free(str, TRUE);
 	return ret;
@@ -2106,7 +2502,6 @@ gint search_replace_match(ScintillaObject *sci, const GeanyMatchInfo *match, con
 
 gint search_find_text(ScintillaObject *sci, GeanyFindFlags flags, struct Sci_TextToFind *ttf, GeanyMatchInfo **match_)
 {
-	GeanyMatchInfo *match = NULL;
 	GRegex *regex;
 	gint ret;
 
@@ -2122,12 +2517,21 @@ gint search_find_text(ScintillaObject *sci, GeanyFindFlags flags, struct Sci_Tex
 	if (!regex)
 		return -1;
 
-	match = match_info_new(flags, 0, 0);
+	ret = find_text_regex(sci, regex, flags, ttf, match_);
+
+	g_regex_unref(regex);
+	return ret;
+}
 
-	ret = find_regex(sci, ttf->chrg.cpMin, regex, flags & GEANY_FIND_MULTILINE, match);
-	if (ret >= ttf->chrg.cpMax)
-		ret = -1;
-	else if (ret >= 0)
+
+static gint find_text_regex(ScintillaObject *sci, GRegex *regex, GeanyFindFlags flags,
+		struct Sci_TextToFind *ttf, GeanyMatchInfo **match_)
+{
+	GeanyMatchInfo *match = match_info_new(flags, 0, 0);
+	gint ret;
+
+	ret = find_regex(sci, ttf->chrg.cpMin, ttf->chrg.cpMax, regex, flags & GEANY_FIND_MULTILINE, match);
+	if (ret >= 0)
 	{
 		ttf->chrgText.cpMin = match->start;
 		ttf->chrgText.cpMax = match->end;
@@ -2138,7 +2542,6 @@ gint search_find_text(ScintillaObject *sci, GeanyFindFlags flags, struct Sci_Tex
 	else
 		geany_match_info_free(match);
 
-	g_regex_unref(regex);
 	return ret;
 }
 
@@ -2153,6 +2556,7 @@ static gint find_document_usage(GeanyDocument *doc, const gchar *search_text, Ge
 
 	g_return_val_if_fail(DOC_VALID(doc), 0);
 
+	document_ensure_loaded(doc);
 	short_file_name = g_path_get_basename(DOC_FILENAME(doc));
 
 	ttf.chrg.cpMin = 0;
@@ -2199,7 +2603,7 @@ void search_find_usage(const gchar *search_text, const gchar *original_search_te
 	}
 
 	gtk_notebook_set_current_page(GTK_NOTEBOOK(msgwindow.notebook), MSG_MESSAGE);
-	gtk_list_store_clear(msgwindow.store_msg);
+	msgwin_clear_tab(MSG_MESSAGE);
 
 	if (! in_session)
 	{	/* use current document */
@@ -2236,12 +2640,20 @@ void search_find_usage(const gchar *search_text, const gchar *original_search_te
 
 /* ttf is updated to include the last match position (ttf->chrg.cpMin) and
  * the new search range end (ttf->chrg.cpMax).
- * Note: Normally you would call sci_start/end_undo_action() around this call. */
+ * All the matches are found before replacing any, and the replacements are built in one
+ * pass. Only the text of the matches is replaced, adjacent matches at once, so the markers,
+ * folds and indicators of the text in between are kept and the undo history only holds
+ * the replaced text.
+ * Note: Normally you would call sci_start/end_undo_action() and editor_bulk_edit_begin/end()
+ * around this call, so the document isn't notified of each replacement. */
 guint search_replace_range(ScintillaObject *sci, struct Sci_TextToFind *ttf,
 		GeanyFindFlags flags, const gchar *replace_text)
 {
 	gint count = 0;
 	gint offset = 0; /* difference between search pos and replace pos */
+	gint run_start;	/* search pos of the first of the adjacent matches in str */
+	gint last_start = 0;
+	GString *str;
 	GSList *match, *matches;
 
 	g_return_val_if_fail(sci != NULL && ttf->lpstrText != NULL && replace_text != NULL, 0);
@@ -2249,28 +2661,40 @@ guint search_replace_range(ScintillaObject *sci, struct Sci_TextToFind *ttf,
 		return 0;
 
 	matches = find_range(sci, flags, ttf);
+	if (! matches)
+		return 0;
+
+	str = g_string_new(NULL);
+	run_start = ((GeanyMatchInfo *) matches->data)->start;
 	foreach_slist (match, matches)
 	{
 		GeanyMatchInfo *info = match->data;
-		gint replace_len;
-
-		info->start += offset;
-		info->end += offset;
+		GeanyMatchInfo *next = match->next ? match->next->data : NULL;
 
-		replace_len = search_replace_match(sci, info, replace_text);
-		offset += replace_len - (info->end - info->start);
-		count ++;
+		last_start = run_start + offset + (gint) str->len;
+		append_replacement(str, info, replace_text);
+		count++;
 
-		/* on last match, update the last match/new range end */
-		if (! match->next)
+		/* replace the run of adjacent matches ending with this one */
+		if (! next || next->start != info->end)
 		{
-			ttf->chrg.cpMin = info->start;
-			ttf->chrg.cpMax += offset;
+			sci_set_target_start(sci, run_start + offset);
+			sci_set_target_end(sci, info->end + offset);
+			scintilla_send_message(sci, SCI_REPLACETARGET, str->len, (sptr_t) str->str);
+			offset += (gint) str->len - (info->end - run_start);
+			g_string_truncate(str, 0);
+			if (next)
+				run_start = next->start;
 		}
 
 		geany_match_info_free(info);
 	}
 	g_slist_free(matches);
+	g_string_free(str, TRUE);
+
+	/* update the last match/new range end */
+	ttf->chrg.cpMin = last_start;
+	ttf->chrg.cpMax += offset;
 
 	return count;
 }
@@ -133,7 +133,12 @@ void search_find_usage(const gchar *search_text, const gchar *original_search_te
 
 void search_find_selection(struct GeanyDocument *doc, gboolean search_backwards);
 
-gint search_mark_all(struct GeanyDocument *doc, const gchar *search_text, GeanyFindFlags flags);
+void search_mark_all(struct GeanyDocument *doc, const gchar *search_text, GeanyFindFlags flags,
+		const gchar *report_text);
+
+void search_mark_all_text_changed(struct GeanyDocument *doc, gint pos, gint length);
+
+void search_mark_all_stop(struct GeanyDocument *doc);
 
 gint search_replace_match(struct _ScintillaObject *sci, const GeanyMatchInfo *match, const gchar *replace_text);
 
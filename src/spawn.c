@@ -897,32 +897,49 @@ static gboolean spawn_read_cb(GIOChannel *channel, GIOCondition condition, gpoin
 			while ((status = g_io_channel_read_chars(channel, line_buffer->str + n,
 				DEFAULT_IO_LENGTH, &chars_read, NULL)) == G_IO_STATUS_NORMAL)
 			{
+				/* Lines are consumed by advancing line_start, the consumed data is
+				   erased once after the loop, so the read costs linear time however
+				   many lines it holds. */
+				gsize line_start = 0;
+
 				g_string_set_size(line_buffer, n + chars_read);
 
 				while (n < line_buffer->len)
 				{
-					gsize line_len = 0;
+					gsize line_end = 0;
 
-					if (n == sc->max_length)
-						line_len = n;
+					if (n - line_start == sc->max_length)
+						line_end = n;
 					else if (strchr("\n", line_buffer->str[n]))  /* '\n' or '\0' */
-						line_len = n + 1;
+						line_end = n + 1;
 					else if (n < line_buffer->len - 1 && line_buffer->str[n] == '\r')
-						line_len = n + 1 + (line_buffer->str[n + 1] == '\n');
+						line_end = n + 1 + (line_buffer->str[n + 1] == '\n');
 
-					if (!line_len)
+					if (!line_end)
 						n++;
 					else
 					{
-						g_string_append_len(buffer, line_buffer->str, line_len);
-						g_string_erase(line_buffer, 0, line_len);
+						g_string_append_len(buffer, line_buffer->str + line_start,
+							line_end - line_start);
+						n = line_start = line_end;
+						/* a recursive callback may read into the line buffer */
+						if (!sc->buffer)
+						{
+							g_string_erase(line_buffer, 0, line_start);
+							n = line_start = 0;
+						}
 						/* input only, failures are reported separately below */
 						sc->cb.read(buffer, input_cond, sc->cb_data);
 						g_string_truncate(buffer, 0);
-						n = 0;
 					}
 				}
 
+				if (line_start)
+				{
+					g_string_erase(line_buffer, 0, line_start);
+					n -= line_start;
+				}
+
 				if (!failure_cond)
 					break;
 			}
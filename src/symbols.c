@@ -2333,6 +2333,8 @@ static gint get_current_tag_name(GeanyDocument *doc, gchar **tagname, TMTagType
 	gint parent;
 
 	line = sci_get_current_line(doc->editor->sci);
+	/* the fold levels up to the current line are needed, which might not be visible */
+	sci_ensure_styled(doc->editor->sci, sci_get_line_end_position(doc->editor->sci, line));
 	parent = sci_get_fold_parent(doc->editor->sci, line);
 	/* if we're inside a fold level and we have up-to-date tags, get the function from TM */
 	if (parent >= 0 && doc->tm_file != NULL && doc->tm_file->tags_array != NULL &&
@@ -32,6 +32,11 @@ typedef struct {
 } CallbackUserData;
 
 
+/* ctags keeps its parsing state in globals, serialize parsing from the main
+ * thread and the tag manager worker thread */
+static GMutex parse_mutex;
+
+
 void tm_ctags_init(void)
 {
 	initializeParsing();
@@ -65,6 +70,7 @@ void tm_ctags_parse(guchar *buffer, gsize buffer_size,
 		return;
 	}
 
+	g_mutex_lock(&parse_mutex);
 	setTagEntryFunction(parse_callback, &callback_data);
 	while (retry && passCount < 3)
 	{
@@ -98,10 +104,11 @@ void tm_ctags_parse(guchar *buffer, gsize buffer_size,
 		else
 		{
 			g_warning("Unable to open %s", file_name);
-			return;
+			break;
 		}
 		++ passCount;
 	}
+	g_mutex_unlock(&parse_mutex);
 }
 
 
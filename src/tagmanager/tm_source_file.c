@@ -39,12 +39,31 @@ typedef struct
 } TMSourceFilePriv;
 
 
+/* Data passed to the ctags callbacks while parsing */
+typedef struct
+{
+	TMSourceFile *source_file;
+	GPtrArray *tags_array; /* the array receiving the tags */
+} TMParseData;
+
+
 typedef enum {
 	TM_FILE_FORMAT_TAGMANAGER,
 	TM_FILE_FORMAT_PIPE,
-	TM_FILE_FORMAT_CTAGS
+	TM_FILE_FORMAT_CTAGS,
+	TM_FILE_FORMAT_BINARY
 } TMFileFormat;
 
+/* The binary format starts with this line, followed by the little-endian
+ 32 bit format version, the size of the string table, the string table
+ (NUL-terminated strings, each stored once), the number of tags and the
+ tags themselves, each made of BINARY_TAG_FIELDS 32 bit numbers where the
+ strings are offsets into the string table */
+#define BINARY_FORMAT_HEADER "# format=binary\n"
+#define BINARY_FORMAT_VERSION 1
+#define BINARY_NO_STRING G_MAXUINT32
+#define BINARY_TAG_FIELDS 11
+
 /* Note: To preserve binary compatibility, it is very important
 	that you only *append* to this list ! */
 enum
@@ -183,20 +202,20 @@ static gboolean init_tag(TMTag *tag, TMSourceFile *file, const tagEntryInfo *tag
 	if (!tag_entry->name || type == tm_tag_undef_t)
 		return FALSE;
 
-	tag->name = g_strdup(tag_entry->name);
+	tag->name = tm_tag_string_intern(tag_entry->name);
 	tag->type = type;
 	tag->local = tag_entry->isFileScope;
 	tag->pointerOrder = 0;	/* backward compatibility (use var_type instead) */
 	tag->line = tag_entry->lineNumber;
 	if (NULL != tag_entry->extensionFields.signature)
-		tag->arglist = g_strdup(tag_entry->extensionFields.signature);
+		tag->arglist = tm_tag_string_intern(tag_entry->extensionFields.signature);
 	if ((NULL != tag_entry->extensionFields.scopeName) &&
 		(0 != tag_entry->extensionFields.scopeName[0]))
-		tag->scope = g_strdup(tag_entry->extensionFields.scopeName);
+		tag->scope = tm_tag_string_intern(tag_entry->extensionFields.scopeName);
 	if (tag_entry->extensionFields.inheritance != NULL)
-		tag->inheritance = g_strdup(tag_entry->extensionFields.inheritance);
+		tag->inheritance = tm_tag_string_intern(tag_entry->extensionFields.inheritance);
 	if (tag_entry->extensionFields.varType != NULL)
-		tag->var_type = g_strdup(tag_entry->extensionFields.varType);
+		tag->var_type = tm_tag_string_intern(tag_entry->extensionFields.varType);
 	if (tag_entry->extensionFields.access != NULL)
 		tag->access = get_tag_access(tag_entry->extensionFields.access);
 	if (tag_entry->extensionFields.implementation != NULL)
@@ -239,7 +258,7 @@ static gboolean init_tag_from_file(TMTag *tag, TMSourceFile *file, FILE *fp)
 			if (!isprint(*start))
 				return FALSE;
 			else
-				tag->name = g_strdup((gchar*)start);
+				tag->name = tm_tag_string_intern((gchar*)start);
 		}
 		else
 		{
@@ -255,19 +274,19 @@ static gboolean init_tag_from_file(TMTag *tag, TMSourceFile *file, FILE *fp)
 					tag->type = (TMTagType) atoi((gchar*)start + 1);
 					break;
 				case TA_ARGLIST:
-					tag->arglist = g_strdup((gchar*)start + 1);
+					tag->arglist = tm_tag_string_intern((gchar*)start + 1);
 					break;
 				case TA_SCOPE:
-					tag->scope = g_strdup((gchar*)start + 1);
+					tag->scope = tm_tag_string_intern((gchar*)start + 1);
 					break;
 				case TA_POINTER:
 					tag->pointerOrder = atoi((gchar*)start + 1);
 					break;
 				case TA_VARTYPE:
-					tag->var_type = g_strdup((gchar*)start + 1);
+					tag->var_type = tm_tag_string_intern((gchar*)start + 1);
 					break;
 				case TA_INHERITS:
-					tag->inheritance = g_strdup((gchar*)start + 1);
+					tag->inheritance = tm_tag_string_intern((gchar*)start + 1);
 					break;
 				case TA_TIME:  /* Obsolete */
 					break;
@@ -325,10 +344,10 @@ static gboolean init_tag_from_file_alt(TMTag *tag, TMSourceFile *file, FILE *fp)
 			fields = g_strsplit((gchar*)start, "|", -1);
 			field_len = g_strv_length(fields);
 
-			if (field_len >= 1) tag->name = g_strdup(fields[0]);
+			if (field_len >= 1) tag->name = tm_tag_string_intern(fields[0]);
 			else tag->name = NULL;
-			if (field_len >= 2 && fields[1] != NULL) tag->var_type = g_strdup(fields[1]);
-			if (field_len >= 3 && fields[2] != NULL) tag->arglist = g_strdup(fields[2]);
+			if (field_len >= 2 && fields[1] != NULL) tag->var_type = tm_tag_string_intern(fields[1]);
+			if (field_len >= 3 && fields[2] != NULL) tag->arglist = tm_tag_string_intern(fields[2]);
 			tag->type = tm_tag_prototype_t;
 			g_strfreev(fields);
 		}
@@ -362,13 +381,14 @@ static gboolean init_tag_from_file_ctags(TMTag *tag, TMSourceFile *file, FILE *f
 	/* tag name */
 	if (! (tab = strchr(p, '\t')) || p == tab)
 		return FALSE;
-	tag->name = g_strndup(p, (gsize)(tab - p));
+	*tab = '\0';
+	tag->name = tm_tag_string_intern(p);
 	p = tab + 1;
 
 	/* tagfile, unused */
 	if (! (tab = strchr(p, '\t')))
 	{
-		g_free(tag->name);
+		tm_tag_string_release(tag->name);
 		tag->name = NULL;
 		return FALSE;
 	}
@@ -423,8 +443,8 @@ static gboolean init_tag_from_file_ctags(TMTag *tag, TMSourceFile *file, FILE *f
 			}
 			else if (0 == strcmp(key, "inherits")) /* comma-separated list of classes this class inherits from */
 			{
-				g_free(tag->inheritance);
-				tag->inheritance = g_strdup(value);
+				tm_tag_string_release(tag->inheritance);
+				tag->inheritance = tm_tag_string_intern(value);
 			}
 			else if (0 == strcmp(key, "implementation")) /* implementation limit */
 				tag->impl = get_tag_impl(value);
@@ -438,15 +458,15 @@ static gboolean init_tag_from_file_ctags(TMTag *tag, TMSourceFile *file, FILE *f
 					 0 == strcmp(key, "struct") ||
 					 0 == strcmp(key, "union")) /* Name of the class/enum/function/struct/union in which this tag is a member */
 			{
-				g_free(tag->scope);
-				tag->scope = g_strdup(value);
+				tm_tag_string_release(tag->scope);
+				tag->scope = tm_tag_string_intern(value);
 			}
 			else if (0 == strcmp(key, "file")) /* static (local) tag */
 				tag->local = TRUE;
 			else if (0 == strcmp(key, "signature")) /* arglist */
 			{
-				g_free(tag->arglist);
-				tag->arglist = g_strdup(value);
+				tm_tag_string_release(tag->arglist);
+				tag->arglist = tm_tag_string_intern(value);
 			}
 		}
 	}
@@ -519,13 +539,188 @@ static gboolean write_tag(TMTag *tag, FILE *fp, TMTagAttrType attrs)
 		return FALSE;
 }
 
+static void append_uint32(GString *str, guint32 val)
+{
+	val = GUINT32_TO_LE(val);
+	g_string_append_len(str, (const gchar *) &val, sizeof val);
+}
+
+static guint32 get_uint32(const gchar *p)
+{
+	guint32 val;
+
+	memcpy(&val, p, sizeof val);
+	return GUINT32_FROM_LE(val);
+}
+
+/* Returns the offset of str in the string table, adding it if not present yet */
+static guint32 intern_string(GString *table, GHashTable *offsets, const gchar *str)
+{
+	gpointer offset;
+
+	if (str == NULL)
+		return BINARY_NO_STRING;
+	if (g_hash_table_lookup_extended(offsets, str, NULL, &offset))
+		return GPOINTER_TO_UINT(offset);
+
+	offset = GUINT_TO_POINTER(table->len);
+	/* including the terminating NUL */
+	g_string_append_len(table, str, strlen(str) + 1);
+	g_hash_table_insert(offsets, (gpointer) str, offset);
+	return GPOINTER_TO_UINT(offset);
+}
+
+/* Returns a copy of the string at offset in the string table, or NULL */
+static gchar *get_table_string(const gchar *table, guint32 table_size, guint32 offset)
+{
+	if (offset == BINARY_NO_STRING || offset >= table_size)
+		return NULL;
+	return tm_tag_string_intern(table + offset);
+}
+
+/* Serializes tags_array in the binary format, keeping the order of the tags */
+static GString *write_binary_tags(GPtrArray *tags_array)
+{
+	GString *table = g_string_new(NULL);
+	GString *tags = g_string_sized_new(tags_array->len * BINARY_TAG_FIELDS * 4);
+	GString *out = g_string_new(BINARY_FORMAT_HEADER);
+	GHashTable *offsets = g_hash_table_new(g_str_hash, g_str_equal);
+	guint i;
+
+	for (i = 0; i < tags_array->len; i++)
+	{
+		TMTag *tag = TM_TAG(tags_array->pdata[i]);
+
+		append_uint32(tags, intern_string(table, offsets, tag->name));
+		append_uint32(tags, tag->type);
+		append_uint32(tags, intern_string(table, offsets, tag->arglist));
+		append_uint32(tags, intern_string(table, offsets, tag->scope));
+		append_uint32(tags, intern_string(table, offsets, tag->inheritance));
+		append_uint32(tags, intern_string(table, offsets, tag->var_type));
+		append_uint32(tags, tag->pointerOrder);
+		append_uint32(tags, (guchar) tag->access);
+		append_uint32(tags, (guchar) tag->impl);
+		append_uint32(tags, tag->local);
+		append_uint32(tags, tag->line);
+	}
+
+	append_uint32(out, BINARY_FORMAT_VERSION);
+	append_uint32(out, table->len);
+	g_string_append_len(out, table->str, table->len);
+	append_uint32(out, tags_array->len);
+	g_string_append_len(out, tags->str, tags->len);
+
+	g_hash_table_destroy(offsets);
+	g_string_free(tags, TRUE);
+	g_string_free(table, TRUE);
+	return out;
+}
+
+/* Reads a file in the binary format. The strings are copied so the file is only
+ mapped while reading. */
+static GPtrArray *read_binary_tags_file(const gchar *tags_file, TMParserType mode)
+{
+	GMappedFile *map;
+	GPtrArray *file_tags = NULL;
+	const gchar *p, *end, *table;
+	guint32 table_size, count, i;
+
+	map = g_mapped_file_new(tags_file, FALSE, NULL);
+	if (!map)
+		return NULL;
+
+	p = g_mapped_file_get_contents(map);
+	end = p + g_mapped_file_get_length(map);
+	if ((gsize) (end - p) < strlen(BINARY_FORMAT_HEADER) + 8)
+		goto cleanup;
+	p += strlen(BINARY_FORMAT_HEADER);
+	if (get_uint32(p) != BINARY_FORMAT_VERSION)
+		goto cleanup;
+
+	table_size = get_uint32(p + 4);
+	p += 8;
+	/* the string table must end with a NUL so that no string can overflow it */
+	if ((gsize) (end - p) < (guint64) table_size + 4 ||
+		(table_size > 0 && p[table_size - 1] != '\0'))
+		goto cleanup;
+	table = p;
+	p += table_size;
+
+	count = get_uint32(p);
+	p += 4;
+	if ((guint64) (end - p) < (guint64) count * BINARY_TAG_FIELDS * 4)
+		goto cleanup;
+
+	file_tags = g_ptr_array_sized_new(count);
+	for (i = 0; i < count; i++, p += BINARY_TAG_FIELDS * 4)
+	{
+		TMTag *tag = tm_tag_new();
+
+		tag->name = get_table_string(table, table_size, get_uint32(p));
+		tag->type = get_uint32(p + 4);
+		tag->arglist = get_table_string(table, table_size, get_uint32(p + 8));
+		tag->scope = get_table_string(table, table_size, get_uint32(p + 12));
+		tag->inheritance = get_table_string(table, table_size, get_uint32(p + 16));
+		tag->var_type = get_table_string(table, table_size, get_uint32(p + 20));
+		tag->pointerOrder = get_uint32(p + 24);
+		tag->access = (char) get_uint32(p + 28);
+		tag->impl = (char) get_uint32(p + 32);
+		tag->local = get_uint32(p + 36);
+		tag->line = get_uint32(p + 40);
+		tag->lang = mode;
+
+		if (tag->name == NULL)
+			tm_tag_unref(tag);
+		else
+			g_ptr_array_add(file_tags, tag);
+	}
+
+cleanup:
+	g_mapped_file_unref(map);
+	return file_tags;
+}
+
+static TMFileFormat get_tags_file_format(const gchar *first_line)
+{
+	const gchar *buf = first_line;
+
+	if (strcmp(buf, BINARY_FORMAT_HEADER) == 0)
+		return TM_FILE_FORMAT_BINARY;
+	else if (buf[0] == '#' && strstr(buf, "format=pipe") != NULL)
+		return TM_FILE_FORMAT_PIPE;
+	else if (buf[0] == '#' && strstr(buf, "format=tagmanager") != NULL)
+		return TM_FILE_FORMAT_TAGMANAGER;
+	else if (buf[0] == '#' && strstr(buf, "format=ctags") != NULL)
+		return TM_FILE_FORMAT_CTAGS;
+	else if (strncmp(buf, "!_TAG_", 6) == 0)
+		return TM_FILE_FORMAT_CTAGS;
+	else
+	{	/* We didn't find a valid format specification, so we try to auto-detect the format
+		 * by counting the pipe characters on the first line and asumme pipe format when
+		 * we find more than one pipe on the line. */
+		guint i, pipe_cnt = 0, tab_cnt = 0;
+		for (i = 0; i < BUFSIZ && buf[i] != '\0' && pipe_cnt < 2; i++)
+		{
+			if (buf[i] == '|')
+				pipe_cnt++;
+			else if (buf[i] == '\t')
+				tab_cnt++;
+		}
+		if (pipe_cnt > 1)
+			return TM_FILE_FORMAT_PIPE;
+		else if (tab_cnt > 1)
+			return TM_FILE_FORMAT_CTAGS;
+	}
+	return TM_FILE_FORMAT_TAGMANAGER;
+}
+
 GPtrArray *tm_source_file_read_tags_file(const gchar *tags_file, TMParserType mode)
 {
 	guchar buf[BUFSIZ];
 	FILE *fp;
 	GPtrArray *file_tags;
 	TMTag *tag;
-	TMFileFormat format = TM_FILE_FORMAT_TAGMANAGER;
+	TMFileFormat format;
 
 	if (NULL == (fp = g_fopen(tags_file, "r")))
 		return NULL;
@@ -534,35 +729,15 @@ GPtrArray *tm_source_file_read_tags_file(const gchar *tags_file, TMParserType mo
 		fclose(fp);
 		return NULL; /* early out on error */
 	}
-	else
-	{	/* We read the first line for the format specification. */
-		if (buf[0] == '#' && strstr((gchar*) buf, "format=pipe") != NULL)
-			format = TM_FILE_FORMAT_PIPE;
-		else if (buf[0] == '#' && strstr((gchar*) buf, "format=tagmanager") != NULL)
-			format = TM_FILE_FORMAT_TAGMANAGER;
-		else if (buf[0] == '#' && strstr((gchar*) buf, "format=ctags") != NULL)
-			format = TM_FILE_FORMAT_CTAGS;
-		else if (strncmp((gchar*) buf, "!_TAG_", 6) == 0)
-			format = TM_FILE_FORMAT_CTAGS;
-		else
-		{	/* We didn't find a valid format specification, so we try to auto-detect the format
-			 * by counting the pipe characters on the first line and asumme pipe format when
-			 * we find more than one pipe on the line. */
-			guint i, pipe_cnt = 0, tab_cnt = 0;
-			for (i = 0; i < BUFSIZ && buf[i] != '\0' && pipe_cnt < 2; i++)
-			{
-				if (buf[i] == '|')
-					pipe_cnt++;
-				else if (buf[i] == '\t')
-					tab_cnt++;
-			}
-			if (pipe_cnt > 1)
-				format = TM_FILE_FORMAT_PIPE;
-			else if (tab_cnt > 1)
-				format = TM_FILE_FORMAT_CTAGS;
-		}
-		rewind(fp); /* reset the file pointer, to start reading again from the beginning */
+
+	/* We read the first line for the format specification. */
+	format = get_tags_file_format((gchar*) buf);
+	if (format == TM_FILE_FORMAT_BINARY)
+	{
+		fclose(fp);
+		return read_binary_tags_file(tags_file, mode);
 	}
+	rewind(fp); /* reset the file pointer, to start reading again from the beginning */
 
 	file_tags = g_ptr_array_new();
 	while (NULL != (tag = new_tag_from_tags_file(NULL, fp, mode, format)))
@@ -572,6 +747,23 @@ GPtrArray *tm_source_file_read_tags_file(const gchar *tags_file, TMParserType mo
 	return file_tags;
 }
 
+/* Checks whether the tags file is in the binary format written by
+ tm_source_file_write_binary_tags_file() */
+gboolean tm_source_file_is_binary_tags_file(const gchar *tags_file)
+{
+	gchar buf[sizeof BINARY_FORMAT_HEADER];
+	FILE *fp;
+	gboolean ret;
+
+	if (NULL == (fp = g_fopen(tags_file, "r")))
+		return FALSE;
+	ret = NULL != fgets(buf, sizeof buf, fp) &&
+		get_tags_file_format(buf) == TM_FILE_FORMAT_BINARY;
+	fclose(fp);
+
+	return ret;
+}
+
 gboolean tm_source_file_write_tags_file(const gchar *tags_file, GPtrArray *tags_array)
 {
 	guint i;
@@ -601,8 +793,25 @@ gboolean tm_source_file_write_tags_file(const gchar *tags_file, GPtrArray *tags_
 	return ret;
 }
 
+/* Writes the tags in the binary format. The file is replaced atomically.
+ Sorting the tags with the global tags sort attributes beforehand spares
+ sorting them when they are loaded. */
+gboolean tm_source_file_write_binary_tags_file(const gchar *tags_file, GPtrArray *tags_array)
+{
+	GString *contents;
+	gboolean ret;
+
+	g_return_val_if_fail(tags_array && tags_file, FALSE);
+
+	contents = write_binary_tags(tags_array);
+	ret = g_file_set_contents(tags_file, contents->str, contents->len, NULL);
+	g_string_free(contents, TRUE);
+
+	return ret;
+}
+
 /* add argument list of __init__() Python methods to the class tag */
-static void update_python_arglist(const TMTag *tag, TMSourceFile *current_source_file)
+static void update_python_arglist(const TMTag *tag, GPtrArray *tags_array)
 {
 	guint i;
 	const char *parent_tag_name;
@@ -618,13 +827,13 @@ static void update_python_arglist(const TMTag *tag, TMSourceFile *current_source
 		parent_tag_name = tag->scope;
 
 	/* going in reverse order because the tag was added recently */
-	for (i = current_source_file->tags_array->len; i > 0; i--)
+	for (i = tags_array->len; i > 0; i--)
 	{
-		TMTag *prev_tag = (TMTag *) current_source_file->tags_array->pdata[i - 1];
+		TMTag *prev_tag = (TMTag *) tags_array->pdata[i - 1];
 		if (g_strcmp0(prev_tag->name, parent_tag_name) == 0)
 		{
-			g_free(prev_tag->arglist);
-			prev_tag->arglist = g_strdup(tag->arglist);
+			tm_tag_string_release(prev_tag->arglist);
+			prev_tag->arglist = tm_tag_string_intern(tag->arglist);
 			break;
 		}
 	}
@@ -633,9 +842,9 @@ static void update_python_arglist(const TMTag *tag, TMSourceFile *current_source
 /* new parsing pass ctags callback function */
 static gboolean ctags_pass_start(void *user_data)
 {
-	TMSourceFile *current_source_file = user_data;
+	TMParseData *data = user_data;
 
-	tm_tags_array_free(current_source_file->tags_array, FALSE);
+	tm_tags_array_free(data->tags_array, FALSE);
 	return TRUE;
 }
 
@@ -643,19 +852,19 @@ static gboolean ctags_pass_start(void *user_data)
 static gboolean ctags_new_tag(const tagEntryInfo *const tag,
 	void *user_data)
 {
-	TMSourceFile *current_source_file = user_data;
+	TMParseData *data = user_data;
 	TMTag *tm_tag = tm_tag_new();
 
-	if (!init_tag(tm_tag, current_source_file, tag))
+	if (!init_tag(tm_tag, data->source_file, tag))
 	{
 		tm_tag_unref(tm_tag);
 		return TRUE;
 	}
 
 	if (tm_tag->lang == TM_PARSER_PYTHON)
-		update_python_arglist(tm_tag, current_source_file);
+		update_python_arglist(tm_tag, data->tags_array);
 
-	g_ptr_array_add(current_source_file->tags_array, tm_tag);
+	g_ptr_array_add(data->tags_array, tm_tag);
 
 	return TRUE;
 }
@@ -792,6 +1001,7 @@ gboolean tm_source_file_parse(TMSourceFile *source_file, guchar* text_buf, gsize
 	gboolean retry = TRUE;
 	gboolean parse_file = FALSE;
 	gboolean free_buf = FALSE;
+	TMParseData data;
 
 	if ((NULL == source_file) || (NULL == source_file->file_name))
 	{
@@ -836,14 +1046,42 @@ gboolean tm_source_file_parse(TMSourceFile *source_file, guchar* text_buf, gsize
 
 	tm_tags_array_free(source_file->tags_array, FALSE);
 
+	data.source_file = source_file;
+	data.tags_array = source_file->tags_array;
 	tm_ctags_parse(parse_file ? NULL : text_buf, buf_size, file_name,
-		source_file->lang, ctags_new_tag, ctags_pass_start, source_file);
+		source_file->lang, ctags_new_tag, ctags_pass_start, &data);
 
 	if (free_buf)
 		g_free(text_buf);
 	return !retry;
 }
 
+/* Parses the text-buffer into a new array of tags belonging to source_file.
+ Unlike tm_source_file_parse(), source_file->tags_array is left untouched so
+ this can be called from a worker thread while the main thread keeps using the
+ current tags. The source file must be kept alive during the call.
+ @param source_file The source file the tags belong to
+ @param text_buf The text buffer to parse
+ @param buf_size The size of text_buf.
+ @return The new unsorted tag array, to be freed with tm_tags_array_free().
+*/
+GPtrArray *tm_source_file_parse_buffer(TMSourceFile *source_file, guchar* text_buf,
+	gsize buf_size)
+{
+	TMParseData data;
+
+	g_return_val_if_fail(source_file != NULL && source_file->file_name != NULL, NULL);
+
+	data.source_file = source_file;
+	data.tags_array = g_ptr_array_new();
+	if (source_file->lang != TM_PARSER_NONE && text_buf != NULL && buf_size != 0)
+	{
+		tm_ctags_parse(text_buf, buf_size, source_file->file_name,
+			source_file->lang, ctags_new_tag, ctags_pass_start, &data);
+	}
+	return data.tags_array;
+}
+
 /* Gets the name associated with the language index.
  @param lang The language index.
  @return The language name, or NULL.
@@ -53,10 +53,17 @@ TMParserType tm_source_file_get_named_lang(const gchar *name);
 gboolean tm_source_file_parse(TMSourceFile *source_file, guchar* text_buf, gsize buf_size,
 	gboolean use_buffer);
 
+GPtrArray *tm_source_file_parse_buffer(TMSourceFile *source_file, guchar* text_buf,
+	gsize buf_size);
+
 GPtrArray *tm_source_file_read_tags_file(const gchar *tags_file, TMParserType mode);
 
 gboolean tm_source_file_write_tags_file(const gchar *tags_file, GPtrArray *tags_array);
 
+gboolean tm_source_file_write_binary_tags_file(const gchar *tags_file, GPtrArray *tags_array);
+
+gboolean tm_source_file_is_binary_tags_file(const gchar *tags_file);
+
 #endif /* GEANY_PRIVATE */
 
 G_END_DECLS
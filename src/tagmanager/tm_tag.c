@@ -74,6 +74,23 @@ static void log_tag_free(TMTag *tag)
 #endif /* DEBUG_TAG_REFS */
 
 
+/* The strings of tags are interned: equal strings share a single refcounted copy,
+ * which saves a lot of memory as names, scopes and types repeat heavily across
+ * the tags of a workspace. Tags are also created in parser threads, hence the lock. */
+typedef struct
+{
+	guint refcount;
+	gchar str[1];
+} TMInternedString;
+
+#define INTERNED_STRING(s) \
+	((TMInternedString *) (void *) ((s) - G_STRUCT_OFFSET(TMInternedString, str)))
+
+static GHashTable *string_pool = NULL;
+static gsize string_pool_size = 0;
+G_LOCK_DEFINE_STATIC(string_pool);
+
+
 typedef struct
 {
 	guint *sort_attrs;
@@ -115,11 +132,92 @@ TMTag *tm_tag_new(void)
 */
 static void tm_tag_destroy(TMTag *tag)
 {
-	g_free(tag->name);
-	g_free(tag->arglist);
-	g_free(tag->scope);
-	g_free(tag->inheritance);
-	g_free(tag->var_type);
+	tm_tag_string_release(tag->name);
+	tm_tag_string_release(tag->arglist);
+	tm_tag_string_release(tag->scope);
+	tm_tag_string_release(tag->inheritance);
+	tm_tag_string_release(tag->var_type);
+}
+
+
+/*
+ Gets a reference to the shared copy of a string, for use as a tag string.
+ The returned string must not be modified and has to be released with
+ tm_tag_string_release(), which tm_tag_unref() does for the string fields of a tag.
+ Safe to call from any thread.
+ @param str The string to intern, can be NULL.
+ @return The interned string, or NULL if str is NULL.
+*/
+gchar *tm_tag_string_intern(const gchar *str)
+{
+	TMInternedString *istr;
+
+	if (str == NULL)
+		return NULL;
+
+	G_LOCK(string_pool);
+	if (G_UNLIKELY(string_pool == NULL))
+		string_pool = g_hash_table_new(g_str_hash, g_str_equal);
+
+	istr = g_hash_table_lookup(string_pool, str);
+	if (istr != NULL)
+		istr->refcount++;
+	else
+	{
+		gsize size = G_STRUCT_OFFSET(TMInternedString, str) + strlen(str) + 1;
+
+		istr = g_malloc(size);
+		istr->refcount = 1;
+		strcpy(istr->str, str);
+		g_hash_table_insert(string_pool, istr->str, istr);
+		string_pool_size += size;
+	}
+	G_UNLOCK(string_pool);
+
+	return istr->str;
+}
+
+
+/*
+ Releases a reference to a string returned by tm_tag_string_intern().
+ Safe to call from any thread.
+ @param str The interned string, can be NULL.
+*/
+void tm_tag_string_release(gchar *str)
+{
+	TMInternedString *istr;
+
+	if (str == NULL)
+		return;
+
+	istr = INTERNED_STRING(str);
+	G_LOCK(string_pool);
+	if (--istr->refcount == 0)
+	{
+		g_hash_table_remove(string_pool, istr->str);
+		string_pool_size -= G_STRUCT_OFFSET(TMInternedString, str) + strlen(istr->str) + 1;
+		g_free(istr);
+	}
+	G_UNLOCK(string_pool);
+}
+
+
+/*
+ Gets the size of the interned tag strings.
+ @param n_strings Return location for the number of distinct strings, or NULL.
+ @return The memory used by the strings, in bytes, excluding the hash table.
+*/
+gsize tm_tag_string_pool_size(guint *n_strings)
+{
+	gsize size;
+
+	G_LOCK(string_pool);
+	if (n_strings)
+		*n_strings = string_pool ? g_hash_table_size(string_pool) : 0;
+	size = string_pool_size;
+	G_UNLOCK(string_pool);
+
+	return size;
 }
 
 
@@ -213,12 +311,12 @@ static gint tm_tag_compare(gconstpointer ptr1, gconstpointer ptr2, gpointer user
 	return returnval;
 }
 
-gboolean tm_tags_equal(const TMTag *a, const TMTag *b)
+static gboolean tags_equal(const TMTag *a, const TMTag *b, gboolean compare_line)
 {
 	if (a == b)
 		return TRUE;
 
-	return (a->line == b->line &&
+	return ((!compare_line || a->line == b->line) &&
 			a->file == b->file /* ptr comparison */ &&
 			strcmp(FALLBACK(a->name, ""), FALLBACK(b->name, "")) == 0 &&
 			a->type == b->type &&
@@ -233,6 +331,18 @@ gboolean tm_tags_equal(const TMTag *a, const TMTag *b)
 			strcmp(FALLBACK(a->var_type, ""), FALLBACK(b->var_type, "")) == 0);
 }
 
+gboolean tm_tags_equal(const TMTag *a, const TMTag *b)
+{
+	return tags_equal(a, b, TRUE);
+}
+
+/* Like tm_tags_equal() but ignores the line number, which changes for all tags
+ * following an inserted or deleted line. */
+gboolean tm_tags_equal_except_line(const TMTag *a, const TMTag *b)
+{
+	return tags_equal(a, b, FALSE);
+}
+
 /*
  Removes NULL tag entries from an array of tags. Called after tm_tags_dedup() since 
  this function substitutes duplicate entries with NULL
@@ -303,6 +413,30 @@ void tm_tags_sort(GPtrArray *tags_array, TMTagAttrType *sort_attributes,
 		tm_tags_dedup(tags_array, sort_attributes, unref_duplicates);
 }
 
+/*
+ Checks whether an array of tags is sorted on the specified attributes and free
+ of duplicates, e.g. because it was sorted before being written to a file.
+ @param tags_array The array of tags to check
+ @param sort_attributes Attributes the array should be sorted on (int array terminated by 0)
+ @return TRUE if sorting and deduplicating the array wouldn't change it.
+*/
+gboolean tm_tags_is_sorted(GPtrArray *tags_array, TMTagAttrType *sort_attributes)
+{
+	TMSortOptions sort_options;
+	guint i;
+
+	g_return_val_if_fail(tags_array, FALSE);
+
+	sort_options.sort_attrs = sort_attributes;
+	sort_options.partial = FALSE;
+	for (i = 1; i < tags_array->len; ++i)
+	{
+		if (tm_tag_compare(&(tags_array->pdata[i - 1]), &(tags_array->pdata[i]), &sort_options) >= 0)
+			return FALSE;
+	}
+	return TRUE;
+}
+
 void tm_tags_remove_file_tags(TMSourceFile *source_file, GPtrArray *tags_array)
 {
 	guint i;
@@ -367,6 +501,60 @@ void tm_tags_remove_file_tags(TMSourceFile *source_file, GPtrArray *tags_array)
 	tm_tags_prune(tags_array);
 }
 
+/* Replaces the tags of old_tags found in tags_array with the tags at the same
+ * index in new_tags, without re-sorting tags_array. This is only valid if
+ * the tags of new_tags differ from old_tags in their line number only (see
+ * tm_tags_equal_except_line()) and both arrays are sorted the same way, because
+ * then the sort order of tags_array is preserved. */
+void tm_tags_replace_file_tags(GPtrArray *old_tags, GPtrArray *new_tags, GPtrArray *tags_array)
+{
+	guint i;
+
+	g_return_if_fail(old_tags->len == new_tags->len);
+
+	/* choose between an O(tags_array->len) and an
+	 * O(old_tags->len * log(tags_array->len)) algorithm the same way as
+	 * tm_tags_remove_file_tags() does */
+	if (old_tags->len != 0 && tags_array->len / old_tags->len < 20)
+	{
+		GHashTable *replacements = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+		for (i = 0; i < old_tags->len; i++)
+			g_hash_table_insert(replacements, old_tags->pdata[i], new_tags->pdata[i]);
+
+		for (i = 0; i < tags_array->len; i++)
+		{
+			TMTag *new_tag = g_hash_table_lookup(replacements, tags_array->pdata[i]);
+
+			if (new_tag)
+				tags_array->pdata[i] = new_tag;
+		}
+		g_hash_table_destroy(replacements);
+	}
+	else
+	{
+		for (i = 0; i < old_tags->len; i++)
+		{
+			guint j;
+			guint tag_count;
+			TMTag **found;
+			TMTag *tag = old_tags->pdata[i];
+
+			/* the replacement has the same name so the search keeps working
+			 * after replacing the pointer */
+			found = tm_tags_find(tags_array, tag->name, FALSE, &tag_count);
+			for (j = 0; j < tag_count; j++)
+			{
+				if (found[j] == tag)
+				{
+					found[j] = new_tags->pdata[i];
+					break;
+				}
+			}
+		}
+	}
+}
+
 /* Optimized merge sort for merging sorted values from one array to another
  * where one of the arrays is much smaller than the other.
  * The merge complexity depends mostly on the size of the small array
@@ -82,6 +82,7 @@ typedef enum
 
 /**
  * The TMTag structure represents a single tag in the tag manager.
+ * Its strings are shared with other tags and must not be modified.
  **/
 typedef struct TMTag
 {
@@ -113,14 +114,24 @@ GType tm_tag_get_type(void) G_GNUC_CONST;
 
 TMTag *tm_tag_new(void);
 
+gchar *tm_tag_string_intern(const gchar *str);
+
+void tm_tag_string_release(gchar *str);
+
+gsize tm_tag_string_pool_size(guint *n_strings);
+
 void tm_tags_remove_file_tags(TMSourceFile *source_file, GPtrArray *tags_array);
 
+void tm_tags_replace_file_tags(GPtrArray *old_tags, GPtrArray *new_tags, GPtrArray *tags_array);
+
 GPtrArray *tm_tags_merge(GPtrArray *big_array, GPtrArray *small_array, 
 	TMTagAttrType *sort_attributes, gboolean unref_duplicates);
 
 void tm_tags_sort(GPtrArray *tags_array, TMTagAttrType *sort_attributes,
 	gboolean dedup, gboolean unref_duplicates);
 
+gboolean tm_tags_is_sorted(GPtrArray *tags_array, TMTagAttrType *sort_attributes);
+
 GPtrArray *tm_tags_extract(GPtrArray *tags_array, guint tag_types);
 
 void tm_tags_prune(GPtrArray *tags_array);
@@ -140,6 +151,8 @@ TMTag *tm_tag_ref(TMTag *tag);
 
 gboolean tm_tags_equal(const TMTag *a, const TMTag *b);
 
+gboolean tm_tags_equal_except_line(const TMTag *a, const TMTag *b);
+
 const gchar *tm_tag_context_separator(TMParserType lang);
 
 gboolean tm_tag_is_anon(const TMTag *tag);
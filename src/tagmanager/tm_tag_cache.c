@@ -0,0 +1,527 @@
+/*
+ *      tm_tag_cache.c - this file is part of Geany, a fast and lightweight IDE
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Persistent cache of the tags of source files parsed from disk, so the tags of
+ * unchanged files don't have to be parsed again in the next session.
+ *
+ * Every source file gets its own cache file named after the checksum of its path.
+ * The cache file starts with a header identifying the source file contents the
+ * tags were parsed from (modification time, size and checksum) and the parser
+ * (Geany version and language), followed by the tags in a compact binary format.
+ * Numbers are stored in host byte order as the cache isn't meant to be shared
+ * between machines. A cache file whose header doesn't match is just ignored and
+ * overwritten by the next parse.
+ *
+ * The cache also holds the binary conversions of global tags files in text
+ * formats, see tm_tag_cache_get_tags_file_name().
+ *
+ * Loading a cache file updates its modification time, so it tells when the file was
+ * last used. When the cache is enabled, the files that weren't used for a long
+ * time are deleted, then the least recently used files while the cache is too big.
+ */
+
+#include "general.h"
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "tm_tag_cache.h"
+#include "tm_tag.h"
+#include "tm_ctags_wrappers.h"
+
+
+#define CACHE_MAGIC "TMTC"
+/* increase when changing the cache file format */
+#define CACHE_FORMAT_VERSION 1
+/* cache files not used for this long are deleted, in seconds */
+#define CACHE_MAX_AGE (30 * 24 * 60 * 60)
+/* the least recently used cache files are deleted while the cache is bigger */
+#define CACHE_MAX_SIZE (256 * 1024 * 1024)
+
+
+/* set once at startup, read from any thread afterwards */
+static gchar *cache_dir = NULL;
+
+
+typedef struct
+{
+	const gchar *pos;
+	const gchar *end;
+	gboolean error;
+} CacheReader;
+
+typedef struct
+{
+	gchar *file_name;
+	gint64 mtime;
+	gint64 size;
+} CacheEntry;
+
+
+static gint compare_entries_by_mtime(gconstpointer a, gconstpointer b)
+{
+	const CacheEntry *entry_a = a;
+	const CacheEntry *entry_b = b;
+
+	return (entry_a->mtime > entry_b->mtime) - (entry_a->mtime < entry_b->mtime);
+}
+
+
+/* Deletes the cache files not used for CACHE_MAX_AGE, then the least recently used
+ ones until the cache is smaller than CACHE_MAX_SIZE. Runs in a background thread. */
+static gpointer prune_thread(gpointer data)
+{
+	gchar *dir_name = data;
+	GDir *dir = g_dir_open(dir_name, 0, NULL);
+	GArray *entries;
+	const gchar *name;
+	gint64 now = (gint64) time(NULL);
+	gint64 total_size = 0;
+	guint i;
+
+	if (! dir)
+	{
+		g_free(dir_name);
+		return NULL;
+	}
+
+	entries = g_array_new(FALSE, FALSE, sizeof(CacheEntry));
+	while ((name = g_dir_read_name(dir)) != NULL)
+	{
+		gchar *file_name = g_build_filename(dir_name, name, NULL);
+		GStatBuf st;
+
+		if (g_stat(file_name, &st) != 0 || ! S_ISREG(st.st_mode))
+			g_free(file_name);
+		else if (now - (gint64) st.st_mtime > CACHE_MAX_AGE)
+		{
+			g_unlink(file_name);
+			g_free(file_name);
+		}
+		else
+		{
+			CacheEntry entry = {file_name, (gint64) st.st_mtime, (gint64) st.st_size};
+
+			g_array_append_val(entries, entry);
+			total_size += entry.size;
+		}
+	}
+	g_dir_close(dir);
+
+	g_array_sort(entries, compare_entries_by_mtime);
+	for (i = 0; i < entries->len; i++)
+	{
+		CacheEntry *entry = &g_array_index(entries, CacheEntry, i);
+
+		if (total_size > CACHE_MAX_SIZE && g_unlink(entry->file_name) == 0)
+			total_size -= entry->size;
+		g_free(entry->file_name);
+	}
+	g_array_free(entries, TRUE);
+	g_free(dir_name);
+
+	return NULL;
+}
+
+
+/* Enables the tag cache and deletes the cache files that weren't used for long
+ in the background.
+ @param dir The directory where the cache files are stored, created on demand.
+ NULL disables the cache.
+*/
+void tm_tag_cache_set_dir(const gchar *dir)
+{
+	g_free(cache_dir);
+	cache_dir = g_strdup(dir);
+
+	if (cache_dir)
+		g_thread_unref(g_thread_new("tm-tag-cache-prune", prune_thread, g_strdup(cache_dir)));
+}
+
+
+gboolean tm_tag_cache_is_enabled(void)
+{
+	return cache_dir != NULL;
+}
+
+
+static gchar *get_cache_file_name(const gchar *file_name)
+{
+	gchar *checksum = g_compute_checksum_for_string(G_CHECKSUM_MD5, file_name, -1);
+	gchar *cache_file = g_build_filename(cache_dir, checksum, NULL);
+
+	g_free(checksum);
+	return cache_file;
+}
+
+
+static void write_uint32(GString *str, guint32 val)
+{
+	g_string_append_len(str, (const gchar *) &val, sizeof val);
+}
+
+
+static void write_int64(GString *str, gint64 val)
+{
+	g_string_append_len(str, (const gchar *) &val, sizeof val);
+}
+
+
+/* strings are prefixed by their length + 1 so NULL can be told from "" */
+static void write_string(GString *str, const gchar *val)
+{
+	if (val == NULL)
+		write_uint32(str, 0);
+	else
+	{
+		guint32 len = (guint32) strlen(val);
+
+		write_uint32(str, len + 1);
+		g_string_append_len(str, val, len);
+	}
+}
+
+
+static gboolean read_bytes(CacheReader *reader, gpointer dest, gsize size)
+{
+	if (reader->error || (gsize) (reader->end - reader->pos) < size)
+	{
+		reader->error = TRUE;
+		return FALSE;
+	}
+	memcpy(dest, reader->pos, size);
+	reader->pos += size;
+	return TRUE;
+}
+
+
+static guint32 read_uint32(CacheReader *reader)
+{
+	guint32 val = 0;
+
+	read_bytes(reader, &val, sizeof val);
+	return val;
+}
+
+
+static gint64 read_int64(CacheReader *reader)
+{
+	gint64 val = 0;
+
+	read_bytes(reader, &val, sizeof val);
+	return val;
+}
+
+
+/* Returns a newly allocated string, or NULL if the stored string was NULL */
+static gchar *read_string(CacheReader *reader)
+{
+	guint32 len = read_uint32(reader);
+
+	if (reader->error || len == 0)
+		return NULL;
+	if ((gsize) (reader->end - reader->pos) < len - 1)
+	{
+		reader->error = TRUE;
+		return NULL;
+	}
+	reader->pos += len - 1;
+	return g_strndup(reader->pos - (len - 1), len - 1);
+}
+
+
+/* Returns an interned string, see tm_tag_string_intern() */
+static gchar *read_tag_string(CacheReader *reader)
+{
+	gchar *str = read_string(reader);
+	gchar *tag_str = tm_tag_string_intern(str);
+
+	g_free(str);
+	return tag_str;
+}
+
+
+/* Checks that the cache header matches the source file, and if given, the
+ file status or the checksum of the contents */
+static gboolean read_header(CacheReader *reader, TMSourceFile *source_file,
+	const GStatBuf *st, const gchar *checksum)
+{
+	gchar magic[sizeof CACHE_MAGIC - 1];
+	gchar *version, *lang_name, *file_name, *file_checksum;
+	gint64 mtime, size;
+	gboolean valid;
+
+	if (! read_bytes(reader, magic, sizeof magic) ||
+		memcmp(magic, CACHE_MAGIC, sizeof magic) != 0 ||
+		read_uint32(reader) != CACHE_FORMAT_VERSION)
+		return FALSE;
+
+	mtime = read_int64(reader);
+	size = read_int64(reader);
+	version = read_string(reader);
+	lang_name = read_string(reader);
+	file_name = read_string(reader);
+	file_checksum = read_string(reader);
+
+	valid = ! reader->error &&
+		g_strcmp0(version, VERSION) == 0 &&
+		g_strcmp0(lang_name, tm_ctags_get_lang_name(source_file->lang)) == 0 &&
+		/* the cache file name is just a hash of the file name */
+		g_strcmp0(file_name, source_file->file_name) == 0 &&
+		(! st || (mtime == (gint64) st->st_mtime && size == (gint64) st->st_size)) &&
+		(! checksum || g_strcmp0(file_checksum, checksum) == 0);
+
+	g_free(version);
+	g_free(lang_name);
+	g_free(file_name);
+	g_free(file_checksum);
+	return valid;
+}
+
+
+static TMTag *read_tag(CacheReader *reader, TMSourceFile *source_file)
+{
+	TMTag *tag = tm_tag_new();
+
+	tag->name = read_tag_string(reader);
+	tag->type = read_uint32(reader);
+	tag->line = read_int64(reader);
+	tag->local = read_uint32(reader);
+	tag->pointerOrder = read_uint32(reader);
+	tag->arglist = read_tag_string(reader);
+	tag->scope = read_tag_string(reader);
+	tag->inheritance = read_tag_string(reader);
+	tag->var_type = read_tag_string(reader);
+	tag->access = (gchar) read_uint32(reader);
+	tag->impl = (gchar) read_uint32(reader);
+	tag->file = source_file;
+	tag->lang = source_file->lang;
+
+	if (reader->error || tag->name == NULL)
+	{
+		tm_tag_unref(tag);
+		return NULL;
+	}
+	return tag;
+}
+
+
+static void write_tag(GString *str, const TMTag *tag)
+{
+	write_string(str, tag->name);
+	write_uint32(str, tag->type);
+	write_int64(str, tag->line);
+	write_uint32(str, tag->local);
+	write_uint32(str, tag->pointerOrder);
+	write_string(str, tag->arglist);
+	write_string(str, tag->scope);
+	write_string(str, tag->inheritance);
+	write_string(str, tag->var_type);
+	write_uint32(str, (guchar) tag->access);
+	write_uint32(str, (guchar) tag->impl);
+}
+
+
+/* Gets the name of the cache file holding a binary conversion of a global tags file.
+ The name is made of the checksums of the tags file name and language, and of the
+ tags file status and Geany version, so a stale conversion is never used.
+ @param tags_file The global tags file.
+ @param lang The language the tags are read for.
+ @return The newly allocated cache file name, or NULL if the cache is disabled
+ or the cache directory can't be created.
+*/
+gchar *tm_tag_cache_get_tags_file_name(const gchar *tags_file, TMParserType lang)
+{
+	GStatBuf st;
+	gchar *prefix, *key, *prefix_checksum, *checksum, *file_name, *cache_file;
+
+	if (! cache_dir || g_stat(tags_file, &st) != 0 ||
+		g_mkdir_with_parents(cache_dir, 0700) != 0)
+		return NULL;
+
+	prefix = g_strdup_printf("%s\n%d", tags_file, lang);
+	key = g_strdup_printf("%" G_GINT64_FORMAT "\n%" G_GINT64_FORMAT "\n%s",
+		(gint64) st.st_mtime, (gint64) st.st_size, VERSION);
+	prefix_checksum = g_compute_checksum_for_string(G_CHECKSUM_MD5, prefix, -1);
+	checksum = g_compute_checksum_for_string(G_CHECKSUM_MD5, key, -1);
+	file_name = g_strconcat(prefix_checksum, "-", checksum, ".tags", NULL);
+	cache_file = g_build_filename(cache_dir, file_name, NULL);
+
+	g_free(file_name);
+	g_free(checksum);
+	g_free(prefix_checksum);
+	g_free(key);
+	g_free(prefix);
+	return cache_file;
+}
+
+
+/* Deletes the conversions of the same tags file superseded by a new one.
+ @param cache_file The name of the new conversion, see tm_tag_cache_get_tags_file_name().
+*/
+void tm_tag_cache_remove_old_tags_files(const gchar *cache_file)
+{
+	gchar *dir_name = g_path_get_dirname(cache_file);
+	gchar *base_name = g_path_get_basename(cache_file);
+	gchar *separator = strchr(base_name, '-');
+	const gchar *name;
+	GDir *dir;
+
+	dir = separator ? g_dir_open(dir_name, 0, NULL) : NULL;
+	if (dir)
+	{
+		/* the prefix identifies the tags file and language */
+		gsize prefix_len = separator - base_name + 1;
+
+		while ((name = g_dir_read_name(dir)) != NULL)
+		{
+			if (strncmp(name, base_name, prefix_len) == 0 &&
+				g_str_has_suffix(name, ".tags") && strcmp(name, base_name) != 0)
+			{
+				gchar *file_name = g_build_filename(dir_name, name, NULL);
+
+				g_unlink(file_name);
+				g_free(file_name);
+			}
+		}
+		g_dir_close(dir);
+	}
+	g_free(base_name);
+	g_free(dir_name);
+}
+
+
+/* Marks a cache file as recently used so it isn't pruned, for the cache files
+ that aren't read with tm_tag_cache_load() */
+void tm_tag_cache_touch(const gchar *cache_file)
+{
+	g_utime(cache_file, NULL);
+}
+
+
+/* Loads the cached tags of source_file. Safe to call from any thread.
+ @param source_file The source file whose tags are loaded.
+ @param st The status of the file on disk the tags must have been parsed from, or NULL.
+ @param checksum The MD5 checksum of the contents the tags must have been parsed
+ from, or NULL.
+ @return The new unsorted tag array, to be freed with tm_tags_array_free(), or
+ NULL if there is no valid cache entry.
+*/
+GPtrArray *tm_tag_cache_load(TMSourceFile *source_file, const GStatBuf *st,
+	const gchar *checksum)
+{
+	GMappedFile *map;
+	GPtrArray *tags_array = NULL;
+	CacheReader reader;
+	gchar *cache_file;
+	guint32 count, i;
+
+	g_return_val_if_fail(source_file != NULL && source_file->file_name != NULL, NULL);
+
+	if (! cache_dir)
+		return NULL;
+
+	cache_file = get_cache_file_name(source_file->file_name);
+	map = g_mapped_file_new(cache_file, FALSE, NULL);
+	if (! map)
+	{
+		g_free(cache_file);
+		return NULL;
+	}
+
+	reader.pos = g_mapped_file_get_contents(map);
+	reader.end = reader.pos + g_mapped_file_get_length(map);
+	reader.error = FALSE;
+
+	if (read_header(&reader, source_file, st, checksum))
+	{
+		count = read_uint32(&reader);
+		/* don't trust a broken count for the preallocation */
+		tags_array = g_ptr_array_sized_new(MIN(count,
+			(guint32) (reader.end - reader.pos) / 4));
+		for (i = 0; i < count && ! reader.error; i++)
+		{
+			TMTag *tag = read_tag(&reader, source_file);
+
+			if (tag)
+				g_ptr_array_add(tags_array, tag);
+		}
+		if (reader.error)
+		{
+			tm_tags_array_free(tags_array, TRUE);
+			tags_array = NULL;
+		}
+	}
+	g_mapped_file_unref(map);
+
+	/* mark the cache file as recently used so it isn't pruned */
+	if (tags_array)
+		g_utime(cache_file, NULL);
+	g_free(cache_file);
+
+	return tags_array;
+}
+
+
+/* Stores the tags of source_file in the cache. Safe to call from any thread.
+ @param source_file The source file whose tags are stored.
+ @param tags_array The tags parsed from the source file.
+ @param st The status of the file on disk at the time it was read.
+ @param checksum The MD5 checksum of the parsed contents.
+ @return TRUE on success, FALSE on failure.
+*/
+gboolean tm_tag_cache_save(TMSourceFile *source_file, GPtrArray *tags_array,
+	const GStatBuf *st, const gchar *checksum)
+{
+	GString *str;
+	gchar *cache_file;
+	gboolean ret;
+	guint i;
+
+	g_return_val_if_fail(source_file != NULL && source_file->file_name != NULL, FALSE);
+	g_return_val_if_fail(tags_array != NULL && st != NULL && checksum != NULL, FALSE);
+
+	if (! cache_dir)
+		return FALSE;
+	if (g_mkdir_with_parents(cache_dir, 0700) != 0)
+		return FALSE;
+
+	str = g_string_sized_new(64 * (tags_array->len + 1));
+	g_string_append_len(str, CACHE_MAGIC, sizeof CACHE_MAGIC - 1);
+	write_uint32(str, CACHE_FORMAT_VERSION);
+	write_int64(str, st->st_mtime);
+	write_int64(str, st->st_size);
+	write_string(str, VERSION);
+	write_string(str, tm_ctags_get_lang_name(source_file->lang));
+	write_string(str, source_file->file_name);
+	write_string(str, checksum);
+	write_uint32(str, tags_array->len);
+	for (i = 0; i < tags_array->len; i++)
+		write_tag(str, tags_array->pdata[i]);
+
+	/* written to a temporary file and renamed so readers never see a partial file */
+	cache_file = get_cache_file_name(source_file->file_name);
+	ret = g_file_set_contents(cache_file, str->str, str->len, NULL);
+	g_free(cache_file);
+	g_string_free(str, TRUE);
+
+	return ret;
+}
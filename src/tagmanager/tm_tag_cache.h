@@ -0,0 +1,48 @@
+/*
+ *      tm_tag_cache.h - this file is part of Geany, a fast and lightweight IDE
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef TM_TAG_CACHE_H
+#define TM_TAG_CACHE_H
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "tm_source_file.h"
+
+G_BEGIN_DECLS
+
+
+void tm_tag_cache_set_dir(const gchar *dir);
+
+gboolean tm_tag_cache_is_enabled(void);
+
+GPtrArray *tm_tag_cache_load(TMSourceFile *source_file, const GStatBuf *st,
+	const gchar *checksum);
+
+gboolean tm_tag_cache_save(TMSourceFile *source_file, GPtrArray *tags_array,
+	const GStatBuf *st, const gchar *checksum);
+
+gchar *tm_tag_cache_get_tags_file_name(const gchar *tags_file, TMParserType lang);
+
+void tm_tag_cache_remove_old_tags_files(const gchar *cache_file);
+
+void tm_tag_cache_touch(const gchar *cache_file);
+
+G_END_DECLS
+
+#endif /* TM_TAG_CACHE_H */
@@ -34,6 +34,7 @@
 #include "tm_ctags_wrappers.h"
 #include "tm_tag.h"
 #include "tm_parser.h"
+#include "tm_tag_cache.h"
 
 
 /* when changing, always keep the three sort criteria below in sync */
@@ -68,6 +69,162 @@ static TMTagType TM_GLOBAL_TYPE_MASK =
 static TMWorkspace *theWorkspace = NULL;
 
 
+/* A source file update running in the background */
+typedef struct
+{
+	TMSourceFile *source_file; /* a reference is held until the job is freed */
+	guchar *text_buf; /* snapshot of the buffer, owned by the job */
+	gsize buf_size;
+	GPtrArray *tags_array; /* the parsed and sorted tags */
+	gboolean use_cache; /* whether to look up and store the tags in the tag cache */
+	gint cancelled; /* set from the main thread, read atomically */
+	TMWorkspaceUpdateCallback callback;
+	gpointer user_data;
+} TMUpdateJob;
+
+/* Source files added in the background */
+typedef struct
+{
+	GPtrArray *source_files; /* references are held until the job is freed */
+	GCancellable *cancellable;
+	TMWorkspaceAddCallback callback;
+	gpointer user_data;
+} TMAddJob;
+
+/* parses the source files in the background - ctags isn't reentrant so there
+ is a single worker thread */
+static GThreadPool *update_pool = NULL;
+/* the latest job for each source file, main thread only */
+static GHashTable *pending_updates = NULL;
+/* parses the source files added in the background, one batch after another so
+ that they don't delay the updates of the documents */
+static GThreadPool *add_pool = NULL;
+/* the add jobs not finished yet, main thread only */
+static GHashTable *pending_adds = NULL;
+
+/* the tags of theWorkspace->tags_array and theWorkspace->global_tags by scope, so
+ the members of a type can be found without scanning all the tags. Created on
+ first use and kept in sync with the arrays afterwards, NULL until then. */
+static GHashTable *workspace_scope_index = NULL;
+static GHashTable *global_scope_index = NULL;
+
+
+static void update_job_run(gpointer data, gpointer pool_data);
+static void add_job_run(gpointer data, gpointer pool_data);
+
+
+static void cancel_job_foreach(gpointer key, gpointer value, gpointer user_data)
+{
+	TMUpdateJob *job = value;
+
+	g_atomic_int_set(&job->cancelled, TRUE);
+}
+
+
+static void cancel_add_job_foreach(gpointer key, gpointer value, gpointer user_data)
+{
+	TMAddJob *job = key;
+
+	g_cancellable_cancel(job->cancellable);
+}
+
+
+static GHashTable *scope_index_new(void)
+{
+	return g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+		(GDestroyNotify) g_ptr_array_unref);
+}
+
+
+static void scope_index_free(GHashTable **index)
+{
+	if (*index)
+	{
+		g_hash_table_destroy(*index);
+		*index = NULL;
+	}
+}
+
+
+static void scope_index_add_tags(GHashTable *index, const GPtrArray *tags)
+{
+	guint i;
+
+	for (i = 0; i < tags->len; i++)
+	{
+		TMTag *tag = tags->pdata[i];
+		GPtrArray *scope_tags;
+
+		if (!tag->scope || tag->scope[0] == '\0')
+			continue;
+
+		scope_tags = g_hash_table_lookup(index, tag->scope);
+		if (!scope_tags)
+		{
+			scope_tags = g_ptr_array_new();
+			g_hash_table_insert(index, g_strdup(tag->scope), scope_tags);
+		}
+		g_ptr_array_add(scope_tags, tag);
+	}
+}
+
+
+/* Removes the tags of source_file from the index. file_tags are the indexed tags
+ of source_file, only used to find the scopes to update. */
+static void scope_index_remove_tags(GHashTable *index, TMSourceFile *source_file,
+	const GPtrArray *file_tags)
+{
+	GHashTable *done = g_hash_table_new(g_direct_hash, g_direct_equal);
+	guint i, j;
+
+	for (i = 0; i < file_tags->len; i++)
+	{
+		TMTag *tag = file_tags->pdata[i];
+		GPtrArray *scope_tags;
+
+		if (!tag->scope || tag->scope[0] == '\0')
+			continue;
+
+		scope_tags = g_hash_table_lookup(index, tag->scope);
+		if (!scope_tags || g_hash_table_contains(done, scope_tags))
+			continue;
+
+		for (j = scope_tags->len; j > 0; j--)
+		{
+			if (TM_TAG(scope_tags->pdata[j - 1])->file == source_file)
+				g_ptr_array_remove_index_fast(scope_tags, j - 1);
+		}
+		if (scope_tags->len == 0)
+			g_hash_table_remove(index, tag->scope);
+		else
+			g_hash_table_add(done, scope_tags);
+	}
+
+	g_hash_table_destroy(done);
+}
+
+
+/* Gets the scope index of tags_array, or NULL if it isn't indexed */
+static GHashTable *get_scope_index(const GPtrArray *tags_array)
+{
+	GHashTable **index;
+
+	if (tags_array == theWorkspace->tags_array)
+		index = &workspace_scope_index;
+	else if (tags_array == theWorkspace->global_tags)
+		index = &global_scope_index;
+	else
+		return NULL;
+
+	if (!*index)
+	{
+		*index = scope_index_new();
+		scope_index_add_tags(*index, tags_array);
+	}
+	return *index;
+}
+
+
 static gboolean tm_create_workspace(void)
 {
 	theWorkspace = g_new(TMWorkspace, 1);
@@ -78,6 +235,11 @@ static gboolean tm_create_workspace(void)
 	theWorkspace->typename_array = g_ptr_array_new();
 	theWorkspace->global_typename_array = g_ptr_array_new();
 
+	update_pool = g_thread_pool_new(update_job_run, NULL, 1, FALSE, NULL);
+	pending_updates = g_hash_table_new(g_direct_hash, g_direct_equal);
+	add_pool = g_thread_pool_new(add_job_run, NULL, 1, FALSE, NULL);
+	pending_adds = g_hash_table_new(g_direct_hash, g_direct_equal);
+
 	tm_ctags_init();
 	tm_parser_verify_type_mappings();
 
@@ -96,6 +258,22 @@ void tm_workspace_free(void)
 	g_message("Workspace destroyed");
 #endif
 
+	/* let the worker thread finish, pending results are dropped when the
+	 * workspace is gone */
+	g_hash_table_foreach(pending_updates, cancel_job_foreach, NULL);
+	g_hash_table_destroy(pending_updates);
+	pending_updates = NULL;
+	g_thread_pool_free(update_pool, FALSE, TRUE);
+	update_pool = NULL;
+	g_hash_table_foreach(pending_adds, cancel_add_job_foreach, NULL);
+	g_hash_table_destroy(pending_adds);
+	pending_adds = NULL;
+	g_thread_pool_free(add_pool, FALSE, TRUE);
+	add_pool = NULL;
+	tm_tag_cache_set_dir(NULL);
+	scope_index_free(&workspace_scope_index);
+	scope_index_free(&global_scope_index);
+
 	for (i=0; i < theWorkspace->source_files->len; ++i)
 		tm_source_file_free(theWorkspace->source_files->pdata[i]);
 	g_ptr_array_free(theWorkspace->source_files, TRUE);
@@ -141,30 +319,168 @@ static void merge_extracted_tags(GPtrArray **dest, GPtrArray *src, TMTagType tag
 }
 
 
-static void update_source_file(TMSourceFile *source_file, guchar* text_buf,
+/* Checks whether the freshly parsed new_tags only differ from old_tags in the
+ line numbers, which is the case for most edits that don't touch a symbol (e.g.
+ typing inside a function body or adding a line). Both arrays must be sorted
+ with file_tags_sort_attrs. */
+static gboolean tags_moved_only(GPtrArray *old_tags, GPtrArray *new_tags)
+{
+	guint i;
+
+	if (old_tags->len != new_tags->len)
+		return FALSE;
+
+	for (i = 0; i < old_tags->len; i++)
+	{
+		if (!tm_tags_equal_except_line(old_tags->pdata[i], new_tags->pdata[i]))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+
+static gboolean tags_lines_equal(GPtrArray *old_tags, GPtrArray *new_tags)
+{
+	guint i;
+
+	for (i = 0; i < old_tags->len; i++)
+	{
+		if (TM_TAG(old_tags->pdata[i])->line != TM_TAG(new_tags->pdata[i])->line)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+
+/* Replaces the tags of source_file with new_tags (sorted with file_tags_sort_attrs)
+ and updates the workspace arrays. Returns TRUE if the tags changed, FALSE if the
+ old tags were kept. */
+static gboolean update_workspace_tags(TMSourceFile *source_file, GPtrArray *new_tags)
+{
+	GPtrArray *old_tags = source_file->tags_array;
+	gboolean changed = TRUE;
+
+	if (tags_moved_only(old_tags, new_tags))
+	{
+		/* splice the new tags in place of the old ones, the sort order of the
+		 * workspace arrays doesn't change */
+		changed = !tags_lines_equal(old_tags, new_tags);
+		if (changed)
+		{
+			if (workspace_scope_index)
+			{
+				scope_index_remove_tags(workspace_scope_index, source_file, old_tags);
+				scope_index_add_tags(workspace_scope_index, new_tags);
+			}
+			tm_tags_replace_file_tags(old_tags, new_tags, theWorkspace->tags_array);
+			tm_tags_replace_file_tags(old_tags, new_tags, theWorkspace->typename_array);
+			source_file->tags_array = new_tags;
+			tm_tags_array_free(old_tags, TRUE);
+		}
+		else
+		{
+			/* keep the old tags so the tag pointers held elsewhere stay current */
+			tm_tags_array_free(new_tags, TRUE);
+		}
+#ifdef TM_DEBUG
+		g_message("Spliced tags into workspace, line numbers %s",
+			changed ? "changed" : "unchanged");
+#endif
+	}
+	else
+	{
+#ifdef TM_DEBUG
+		g_message("Updating workspace from source file");
+#endif
+		if (workspace_scope_index)
+		{
+			scope_index_remove_tags(workspace_scope_index, source_file, old_tags);
+			scope_index_add_tags(workspace_scope_index, new_tags);
+		}
+		/* tm_tags_remove_file_tags() scans the old source_file->tags_array */
+		tm_tags_remove_file_tags(source_file, theWorkspace->tags_array);
+		tm_tags_remove_file_tags(source_file, theWorkspace->typename_array);
+		source_file->tags_array = new_tags;
+		tm_tags_array_free(old_tags, TRUE);
+
+		tm_workspace_merge_tags(&theWorkspace->tags_array, source_file->tags_array);
+
+		merge_extracted_tags(&(theWorkspace->typename_array), source_file->tags_array, TM_GLOBAL_TYPE_MASK);
+	}
+	return changed;
+}
+
+
+/* Parses the file on disk into source_file->tags_array, or loads the tags from
+ the tag cache if the file didn't change since they were cached */
+static void parse_file_cached(TMSourceFile *source_file)
+{
+	GStatBuf st;
+	GPtrArray *cached_tags;
+	gchar *contents, *checksum;
+	gsize length;
+	guint i;
+
+	/* big files are parsed directly from disk by tm_source_file_parse(), don't
+	 * cache them */
+	if (! tm_tag_cache_is_enabled() || source_file->lang == TM_PARSER_NONE ||
+		g_stat(source_file->file_name, &st) != 0 || st.st_size > 10*1024*1024)
+	{
+		tm_source_file_parse(source_file, NULL, 0, FALSE);
+		return;
+	}
+
+	cached_tags = tm_tag_cache_load(source_file, &st, NULL);
+	if (cached_tags)
+	{
+		tm_tags_array_free(source_file->tags_array, FALSE);
+		for (i = 0; i < cached_tags->len; i++)
+			g_ptr_array_add(source_file->tags_array, cached_tags->pdata[i]);
+		g_ptr_array_free(cached_tags, TRUE);
+		return;
+	}
+
+	if (! g_file_get_contents(source_file->file_name, &contents, &length, NULL))
+	{
+		tm_source_file_parse(source_file, NULL, 0, FALSE);
+		return;
+	}
+	tm_source_file_parse(source_file, (guchar *) contents, length, TRUE);
+	checksum = g_compute_checksum_for_data(G_CHECKSUM_MD5, (guchar *) contents, length);
+	tm_tag_cache_save(source_file, source_file->tags_array, &st, checksum);
+	g_free(checksum);
+	g_free(contents);
+}
+
+
+/* Returns TRUE if the tags of the source file changed */
+static gboolean update_source_file(TMSourceFile *source_file, guchar* text_buf,
 	gsize buf_size, gboolean use_buffer, gboolean update_workspace)
 {
+	GPtrArray *old_tags = NULL;
+	GPtrArray *new_tags;
+
 #ifdef TM_DEBUG
 	g_message("Source file updating based on source file %s", source_file->file_name);
 #endif
 
 	if (update_workspace)
 	{
-		/* tm_source_file_parse() deletes the tag objects - remove the tags from
-		 * workspace while they exist and can be scanned */
-		tm_tags_remove_file_tags(source_file, theWorkspace->tags_array);
-		tm_tags_remove_file_tags(source_file, theWorkspace->typename_array);
+		/* keep the old tags alive until we know whether the workspace arrays
+		 * have to be rebuilt - tm_source_file_parse() would delete them */
+		old_tags = source_file->tags_array;
+		source_file->tags_array = g_ptr_array_new();
 	}
-	tm_source_file_parse(source_file, text_buf, buf_size, use_buffer);
+	if (use_buffer)
+		tm_source_file_parse(source_file, text_buf, buf_size, TRUE);
+	else
+		parse_file_cached(source_file);
 	tm_tags_sort(source_file->tags_array, file_tags_sort_attrs, FALSE, TRUE);
 	if (update_workspace)
 	{
-#ifdef TM_DEBUG
-		g_message("Updating workspace from source file");
-#endif
-		tm_workspace_merge_tags(&theWorkspace->tags_array, source_file->tags_array);
-
-		merge_extracted_tags(&(theWorkspace->typename_array), source_file->tags_array, TM_GLOBAL_TYPE_MASK);
+		new_tags = source_file->tags_array;
+		source_file->tags_array = old_tags;
+		return update_workspace_tags(source_file, new_tags);
 	}
 #ifdef TM_DEBUG
 	else
@@ -172,6 +488,91 @@ static void update_source_file(TMSourceFile *source_file, guchar* text_buf,
 			update_workspace?"TRUE":"FALSE");
 
 #endif
+	return TRUE;
+}
+
+
+/* Drops the result of a background update of source_file which is still running
+ or waiting to be published, if any */
+static void cancel_pending_update(TMSourceFile *source_file)
+{
+	TMUpdateJob *job = g_hash_table_lookup(pending_updates, source_file);
+
+	if (job)
+	{
+		g_atomic_int_set(&job->cancelled, TRUE);
+		g_hash_table_remove(pending_updates, source_file);
+	}
+}
+
+
+static void update_job_free(TMUpdateJob *job)
+{
+	if (job->tags_array)
+		tm_tags_array_free(job->tags_array, TRUE);
+	g_free(job->text_buf);
+	tm_source_file_free(job->source_file);
+	g_slice_free(TMUpdateJob, job);
+}
+
+
+/* Publishes the tags parsed in the background, runs in the main thread */
+static gboolean update_job_finish(gpointer data)
+{
+	TMUpdateJob *job = data;
+
+	/* the workspace might have been freed or the job superseded meanwhile */
+	if (theWorkspace && ! g_atomic_int_get(&job->cancelled) && job->tags_array)
+	{
+		gboolean changed;
+		GPtrArray *new_tags = job->tags_array;
+
+		g_hash_table_remove(pending_updates, job->source_file);
+		job->tags_array = NULL;
+		changed = update_workspace_tags(job->source_file, new_tags);
+		if (job->callback)
+			job->callback(job->source_file, changed, job->user_data);
+	}
+	update_job_free(job);
+
+	return FALSE;
+}
+
+
+/* Parses and sorts the buffer snapshot, runs in the worker thread */
+static void update_job_run(gpointer data, gpointer pool_data)
+{
+	TMUpdateJob *job = data;
+
+	if (! g_atomic_int_get(&job->cancelled))
+	{
+		gchar *checksum = NULL;
+
+		if (job->use_cache)
+		{
+			checksum = g_compute_checksum_for_data(G_CHECKSUM_MD5,
+				job->text_buf, job->buf_size);
+			job->tags_array = tm_tag_cache_load(job->source_file, NULL, checksum);
+		}
+		if (! job->tags_array)
+		{
+			GStatBuf st;
+
+			job->tags_array = tm_source_file_parse_buffer(job->source_file,
+				job->text_buf, job->buf_size);
+			/* the buffer may have been converted from another encoding so it's
+			 * identified by its checksum, the file status is stored as well for
+			 * the lookups from disk */
+			if (checksum && g_stat(job->source_file->file_name, &st) == 0)
+				tm_tag_cache_save(job->source_file, job->tags_array, &st, checksum);
+		}
+		tm_tags_sort(job->tags_array, file_tags_sort_attrs, FALSE, TRUE);
+		g_free(checksum);
+	}
+	g_free(job->text_buf);
+	job->text_buf = NULL;
+
+	g_idle_add(update_job_finish, job);
 }
 
 
@@ -200,18 +601,70 @@ void tm_workspace_add_source_file_noupdate(TMSourceFile *source_file)
  Ctags will use a parsing based on buffer instead of on files.
  You should call this function when you don't want a previous saving of the file
  you're editing. It's useful for a "real-time" updating of the tags.
- The tags array and the tags themselves are destroyed and re-created, hence any
- other tag arrays pointing to these tags should be rebuilt as well. All sorting
- information is also lost.
+ The tags array and the tags themselves may be destroyed and re-created, hence any
+ other tag arrays pointing to these tags should be rebuilt as well unless
+ FALSE is returned. When the tags only moved to different lines, the workspace
+ arrays are updated in place instead of being re-merged.
  @param source_file The source file to update with a buffer.
  @param text_buf A text buffer. The user should take care of allocate and free it after
  the use here.
  @param buf_size The size of text_buf.
+ @return TRUE if the tags changed, FALSE if the old tags were kept.
 */
-void tm_workspace_update_source_file_buffer(TMSourceFile *source_file, guchar* text_buf,
+gboolean tm_workspace_update_source_file_buffer(TMSourceFile *source_file, guchar* text_buf,
 	gsize buf_size)
 {
-	update_source_file(source_file, text_buf, buf_size, TRUE, TRUE);
+	cancel_pending_update(source_file);
+	return update_source_file(source_file, text_buf, buf_size, TRUE, TRUE);
+}
+
+
+/* Updates the source file by reparsing the file on disk, e.g. for documents
+ whose contents aren't loaded.
+ @param source_file The source file to update.
+ @return TRUE if the tags changed, FALSE if the old tags were kept.
+*/
+gboolean tm_workspace_update_source_file(TMSourceFile *source_file)
+{
+	cancel_pending_update(source_file);
+	return update_source_file(source_file, NULL, 0, FALSE, TRUE);
+}
+
+
+/* Like tm_workspace_update_source_file_buffer() but parses and sorts the tags
+ in a worker thread so the caller isn't blocked by slow parsers or big files.
+ The new tags are published from the main loop, replacing the result of any
+ previous background update of the same source file that didn't finish yet.
+ Updating the source file synchronously or removing it from the workspace
+ cancels the background update.
+ @param source_file The source file to update with a buffer.
+ @param text_buf A snapshot of the text buffer, allocated with g_malloc(). The
+ function takes ownership of it.
+ @param buf_size The size of text_buf.
+ @param use_cache Whether to reuse the tags cached for identical contents and to
+ cache the new tags. Should only be used when text_buf matches the file on disk.
+ @param callback Function called from the main loop once the tags are published, or NULL.
+ @param user_data Data passed to callback.
+*/
+void tm_workspace_update_source_file_buffer_async(TMSourceFile *source_file, guchar* text_buf,
+	gsize buf_size, gboolean use_cache, TMWorkspaceUpdateCallback callback, gpointer user_data)
+{
+	TMUpdateJob *job;
+
+	g_return_if_fail(source_file != NULL);
+
+	cancel_pending_update(source_file);
+
+	job = g_slice_new0(TMUpdateJob);
+	job->source_file = g_boxed_copy(tm_source_file_get_type(), source_file);
+	job->text_buf = text_buf;
+	job->buf_size = buf_size;
+	job->use_cache = use_cache;
+	job->callback = callback;
+	job->user_data = user_data;
+
+	g_hash_table_insert(pending_updates, source_file, job);
+	g_thread_pool_push(update_pool, job, NULL);
 }
 
 
@@ -231,6 +684,10 @@ void tm_workspace_remove_source_file(TMSourceFile *source_file)
 	{
 		if (theWorkspace->source_files->pdata[i] == source_file)
 		{
+			cancel_pending_update(source_file);
+			if (workspace_scope_index)
+				scope_index_remove_tags(workspace_scope_index, source_file,
+					source_file->tags_array);
 			tm_tags_remove_file_tags(source_file, theWorkspace->tags_array);
 			tm_tags_remove_file_tags(source_file, theWorkspace->typename_array);
 			g_ptr_array_remove_index_fast(theWorkspace->source_files, i);
@@ -255,6 +712,7 @@ static void tm_workspace_update(void)
 #endif
 
 	g_ptr_array_set_size(theWorkspace->tags_array, 0);
+	scope_index_free(&workspace_scope_index);
 
 #ifdef TM_DEBUG
 	g_message("Total %d objects", theWorkspace->source_files->len);
@@ -284,6 +742,21 @@ static void tm_workspace_update(void)
 }
 
 
+/* Parses the source files from disk without adding them to the workspace,
+ returns once all of them are parsed or cancellable is cancelled */
+static void parse_source_files(GPtrArray *source_files, GCancellable *cancellable)
+{
+	guint i;
+
+	for (i = 0; i < source_files->len; i++)
+	{
+		if (cancellable && g_cancellable_is_cancelled(cancellable))
+			break;
+		update_source_file(source_files->pdata[i], NULL, 0, FALSE, FALSE);
+	}
+}
+
+
 /** Adds multiple source files to the workspace and updates the workspace tag arrays.
  This is more efficient than calling tm_workspace_add_source_file() and
  tm_workspace_update_source_file() separately for each of the files.
@@ -296,15 +769,130 @@ void tm_workspace_add_source_files(GPtrArray *source_files)
 
 	g_return_if_fail(source_files != NULL);
 
+	for (i = 0; i < source_files->len; i++)
+		tm_workspace_add_source_file_noupdate(source_files->pdata[i]);
+	parse_source_files(source_files, NULL);
+
+	tm_workspace_update();
+}
+
+
+#ifdef TM_DEBUG
+static gsize get_tag_strings_size(const TMTag *tag)
+{
+	const gchar *strings[] = {tag->name, tag->arglist, tag->scope, tag->inheritance, tag->var_type};
+	gsize size = 0;
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(strings); i++)
+	{
+		if (strings[i])
+			size += strlen(strings[i]) + 1;
+	}
+	return size;
+}
+
+
+/* Logs the memory used per tag by the strings of the global and workspace tags,
+ * compared to what separate copies of the strings would use */
+static void log_memory_usage(void)
+{
+	GPtrArray *arrays[] = {theWorkspace->global_tags, theWorkspace->tags_array};
+	gsize copied_size = 0, interned_size;
+	guint n_tags = 0, n_strings, i, j;
+
+	for (i = 0; i < G_N_ELEMENTS(arrays); i++)
+	{
+		for (j = 0; j < arrays[i]->len; j++)
+			copied_size += get_tag_strings_size(arrays[i]->pdata[j]);
+		n_tags += arrays[i]->len;
+	}
+	if (n_tags == 0)
+		return;
+
+	/* the pool also holds the strings of the tags of files not in the workspace */
+	interned_size = tm_tag_string_pool_size(&n_strings);
+	g_message("%u tags use %" G_GSIZE_FORMAT " bytes per tag, strings would use %"
+		G_GSIZE_FORMAT " bytes per tag without interning (%u distinct strings)",
+		n_tags, sizeof(TMTag) + interned_size / n_tags,
+		sizeof(TMTag) + copied_size / n_tags, n_strings);
+}
+#endif
+
+
+/* Adds the source files parsed in the background, runs in the main thread */
+static gboolean add_job_finish(gpointer data)
+{
+	TMAddJob *job = data;
+	guint i;
+
+	/* the workspace might have been freed meanwhile */
+	if (theWorkspace)
+		g_hash_table_remove(pending_adds, job);
+	if (theWorkspace && ! g_cancellable_is_cancelled(job->cancellable))
+	{
+		for (i = 0; i < job->source_files->len; i++)
+			tm_workspace_add_source_file_noupdate(job->source_files->pdata[i]);
+		tm_workspace_update();
+#ifdef TM_DEBUG
+		log_memory_usage();
+#endif
+		if (job->callback)
+			job->callback(job->source_files, job->user_data);
+	}
+
+	for (i = 0; i < job->source_files->len; i++)
+		tm_source_file_free(job->source_files->pdata[i]);
+	g_ptr_array_free(job->source_files, TRUE);
+	g_object_unref(job->cancellable);
+	g_slice_free(TMAddJob, job);
+
+	return FALSE;
+}
+
+
+/* Parses the source files of a batch, runs in the add worker thread */
+static void add_job_run(gpointer data, gpointer pool_data)
+{
+	TMAddJob *job = data;
+
+	parse_source_files(job->source_files, job->cancellable);
+	g_idle_add(add_job_finish, job);
+}
+
+
+/* Like tm_workspace_add_source_files() but parses the source files in a
+ background thread and adds them to the workspace from the main loop once all
+ of them are parsed, so that many files can be added without blocking the caller.
+ The source files mustn't be updated until they are added.
+ @param source_files @elementtype{TMSourceFile} The source files to be added to the
+ workspace. References are held until they are added.
+ @param cancellable Cancels adding the source files, or NULL.
+ @param callback Function called from the main loop after the source files were
+ added, or NULL.
+ @param user_data Data passed to callback.
+*/
+void tm_workspace_add_source_files_async(GPtrArray *source_files, GCancellable *cancellable,
+	TMWorkspaceAddCallback callback, gpointer user_data)
+{
+	TMAddJob *job;
+	guint i;
+
+	g_return_if_fail(source_files != NULL);
+
+	job = g_slice_new(TMAddJob);
+	job->source_files = g_ptr_array_sized_new(source_files->len);
 	for (i = 0; i < source_files->len; i++)
 	{
-		TMSourceFile *source_file = source_files->pdata[i];
-		
-		tm_workspace_add_source_file_noupdate(source_file);
-		update_source_file(source_file, NULL, 0, FALSE, FALSE);
+		g_ptr_array_add(job->source_files,
+			g_boxed_copy(tm_source_file_get_type(), source_files->pdata[i]));
 	}
-	
-	tm_workspace_update();
+	job->cancellable = cancellable ? g_object_ref(cancellable) : g_cancellable_new();
+	job->callback = callback;
+	job->user_data = user_data;
+
+	g_hash_table_add(pending_adds, job);
+	g_thread_pool_push(add_pool, job, NULL);
 }
 
 
@@ -326,6 +914,7 @@ void tm_workspace_remove_source_files(GPtrArray *source_files)
 	{
 		TMSourceFile *source_file = source_files->pdata[i];
 		
+		cancel_pending_update(source_file);
 		for (j = 0; j < theWorkspace->source_files->len; j++)
 		{
 			if (theWorkspace->source_files->pdata[j] == source_file)
@@ -340,6 +929,15 @@ void tm_workspace_remove_source_files(GPtrArray *source_files)
 }
 
 
+/* Enables the persistent tag cache used for the source files parsed from disk.
+ @param dir The directory where the cache files are stored, NULL to disable the cache.
+*/
+void tm_workspace_set_tag_cache_dir(const gchar *dir)
+{
+	tm_tag_cache_set_dir(dir);
+}
+
+
 /* Loads the global tag list from the specified file. The global tag list should
  have been first created using tm_workspace_create_global_tags().
  @param tags_file The file containing global tags.
@@ -348,13 +946,37 @@ void tm_workspace_remove_source_files(GPtrArray *source_files)
 */
 gboolean tm_workspace_load_global_tags(const char *tags_file, TMParserType mode)
 {
-	GPtrArray *file_tags, *new_tags;
-
-	file_tags = tm_source_file_read_tags_file(tags_file, mode);
+	GPtrArray *file_tags = NULL, *new_tags;
+	gchar *converted_file = NULL;
+	gboolean convert = FALSE;
+
+	/* tags files in text formats are converted to the binary format on the
+	 * first load, which is read instead afterwards */
+	if (! tm_source_file_is_binary_tags_file(tags_file))
+		converted_file = tm_tag_cache_get_tags_file_name(tags_file, mode);
+	if (converted_file)
+	{
+		file_tags = tm_source_file_read_tags_file(converted_file, mode);
+		if (file_tags)
+			tm_tag_cache_touch(converted_file);
+	}
+	if (!file_tags)
+	{
+		file_tags = tm_source_file_read_tags_file(tags_file, mode);
+		convert = converted_file != NULL;
+	}
 	if (!file_tags)
+	{
+		g_free(converted_file);
 		return FALSE;
+	}
 
-	tm_tags_sort(file_tags, global_tags_sort_attrs, TRUE, TRUE);
+	/* files written by Geany are already sorted */
+	if (! tm_tags_is_sorted(file_tags, global_tags_sort_attrs))
+		tm_tags_sort(file_tags, global_tags_sort_attrs, TRUE, TRUE);
+	if (convert && tm_source_file_write_binary_tags_file(converted_file, file_tags))
+		tm_tag_cache_remove_old_tags_files(converted_file);
+	g_free(converted_file);
 
 	/* reorder the whole array, because tm_tags_find expects a sorted array */
 	new_tags = tm_tags_merge(theWorkspace->global_tags, 
@@ -362,10 +984,15 @@ gboolean tm_workspace_load_global_tags(const char *tags_file, TMParserType mode)
 	g_ptr_array_free(theWorkspace->global_tags, TRUE);
 	g_ptr_array_free(file_tags, TRUE);
 	theWorkspace->global_tags = new_tags;
+	scope_index_free(&global_scope_index);
 
 	g_ptr_array_free(theWorkspace->global_typename_array, TRUE);
 	theWorkspace->global_typename_array = tm_tags_extract(new_tags, TM_GLOBAL_TYPE_MASK);
 
+#ifdef TM_DEBUG
+	log_memory_usage();
+#endif
+
 	return TRUE;
 }
 
@@ -644,7 +1271,8 @@ gboolean tm_workspace_create_global_tags(const char *pre_process, const char **i
 	source_file = tm_source_file_new(temp_file, tm_source_file_get_lang_name(lang));
 	if (!source_file)
 		goto cleanup;
-	update_source_file(source_file, NULL, 0, FALSE, FALSE);
+	/* don't cache the tags of the temporary file */
+	tm_source_file_parse(source_file, NULL, 0, FALSE);
 	if (source_file->tags_array->len == 0)
 	{
 		tm_source_file_free(source_file);
@@ -770,6 +1398,8 @@ static GPtrArray *
 find_scope_members_tags (const GPtrArray *all, TMTag *type_tag, gboolean namespace)
 {
 	TMTagType member_types = tm_tag_max_t & ~(TM_TYPE_WITH_MEMBERS | tm_tag_typedef_t);
+	GHashTable *scope_index = get_scope_index(all);
+	const GPtrArray *candidates = all;
 	GPtrArray *tags = g_ptr_array_new();
 	gchar *scope;
 	guint i;
@@ -782,9 +1412,13 @@ find_scope_members_tags (const GPtrArray *all, TMTag *type_tag, gboolean namespa
 	else
 		scope = g_strdup(type_tag->name);
 
-	for (i = 0; i < all->len; ++i)
+	/* only the tags with the right scope need to be checked for the big arrays */
+	if (scope_index)
+		candidates = g_hash_table_lookup(scope_index, scope);
+
+	for (i = 0; candidates && i < candidates->len; ++i)
 	{
-		TMTag *tag = TM_TAG (all->pdata[i]);
+		TMTag *tag = TM_TAG (candidates->pdata[i]);
 
 		if (tag && (tag->type & member_types) &&
 			tag->scope && tag->scope[0] != '\0' &&
@@ -804,6 +1438,11 @@ find_scope_members_tags (const GPtrArray *all, TMTag *type_tag, gboolean namespa
 		return NULL;
 	}
 
+	/* return the tags in the order of the searched array, like when scanning it */
+	if (scope_index)
+		tm_tags_sort(tags, all == theWorkspace->global_tags ?
+			global_tags_sort_attrs : workspace_tags_sort_attrs, FALSE, FALSE);
+
 	return tags;
 }
 
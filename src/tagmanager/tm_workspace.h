@@ -12,6 +12,7 @@
 #define TM_WORKSPACE_H
 
 #include <glib.h>
+#include <gio/gio.h>
 
 #include "tm_tag.h"
 
@@ -45,6 +46,14 @@ void tm_workspace_remove_source_files(GPtrArray *source_files);
 
 #ifdef GEANY_PRIVATE
 
+/* Called when the tags of a source file updated in the background are published.
+ changed is FALSE if the tags were found to be unchanged and the old ones were kept. */
+typedef void (*TMWorkspaceUpdateCallback) (TMSourceFile *source_file, gboolean changed,
+	gpointer user_data);
+
+/* Called when source files added in the background were added to the workspace. */
+typedef void (*TMWorkspaceAddCallback) (GPtrArray *source_files, gpointer user_data);
+
 const TMWorkspace *tm_get_workspace(void);
 
 gboolean tm_workspace_load_global_tags(const char *tags_file, TMParserType mode);
@@ -63,9 +72,19 @@ GPtrArray *tm_workspace_find_scope_members (TMSourceFile *source_file, const cha
 
 void tm_workspace_add_source_file_noupdate(TMSourceFile *source_file);
 
-void tm_workspace_update_source_file_buffer(TMSourceFile *source_file, guchar* text_buf,
+gboolean tm_workspace_update_source_file_buffer(TMSourceFile *source_file, guchar* text_buf,
 	gsize buf_size);
 
+gboolean tm_workspace_update_source_file(TMSourceFile *source_file);
+
+void tm_workspace_update_source_file_buffer_async(TMSourceFile *source_file, guchar* text_buf,
+	gsize buf_size, gboolean use_cache, TMWorkspaceUpdateCallback callback, gpointer user_data);
+
+void tm_workspace_set_tag_cache_dir(const gchar *dir);
+
+void tm_workspace_add_source_files_async(GPtrArray *source_files, GCancellable *cancellable,
+	TMWorkspaceAddCallback callback, gpointer user_data);
+
 void tm_workspace_free(void);
 
 
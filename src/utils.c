@@ -2176,3 +2176,57 @@ void utils_start_new_geany_instance(const gchar *doc_path)
 	else
 		g_printerr("Unable to find 'geany'");
 }
+
+
+/* Returns the number of threads worth using for work that scales with the CPUs */
+guint utils_get_num_processors(void)
+{
+#if GLIB_CHECK_VERSION(2, 36, 0)
+	return MAX(g_get_num_processors(), 1);
+#else
+	return 2;
+#endif
+}
+
+
+/* Compiles file name patterns like "*.c" for utils_match_patterns(), empty strings are skipped.
+ * Returns a NULL terminated array, free it with utils_free_patterns(). */
+GPatternSpec **utils_compile_patterns(gchar **patterns)
+{
+	GPtrArray *specs = g_ptr_array_new();
+	gchar **pattern;
+
+	foreach_strv(pattern, patterns)
+	{
+		if (**pattern)
+			g_ptr_array_add(specs, g_pattern_spec_new(*pattern));
+	}
+	g_ptr_array_add(specs, NULL);
+	return (GPatternSpec **) g_ptr_array_free(specs, FALSE);
+}
+
+
+void utils_free_patterns(GPatternSpec **specs)
+{
+	GPatternSpec **spec;
+
+	for (spec = specs; *spec; spec++)
+		g_pattern_spec_free(*spec);
+	g_free(specs);
+}
+
+
+/* Returns TRUE if base_name matches any of specs, or if there are no patterns */
+gboolean utils_match_patterns(GPatternSpec **specs, const gchar *base_name)
+{
+	GPatternSpec **spec;
+
+	if (! *specs)
+		return TRUE;
+	for (spec = specs; *spec; spec++)
+	{
+		if (g_pattern_match_string(*spec, base_name))
+			return TRUE;
+	}
+	return FALSE;
+}
@@ -325,6 +325,14 @@ const gchar *utils_resource_dir(GeanyResourceDirType type);
 
 void utils_start_new_geany_instance(const gchar *doc_path);
 
+guint utils_get_num_processors(void);
+
+GPatternSpec **utils_compile_patterns(gchar **patterns);
+
+void utils_free_patterns(GPatternSpec **specs);
+
+gboolean utils_match_patterns(GPatternSpec **specs, const gchar *base_name);
+
 #endif /* GEANY_PRIVATE */
 
 G_END_DECLS
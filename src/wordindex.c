@@ -0,0 +1,357 @@
+/*
+ *      wordindex.c - this file is part of Geany, a fast and lightweight IDE
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Word index: the words of a document sorted by name with their number of occurrences,
+ * used to complete words from the document. It is built on first use and kept up to
+ * date by removing the words around a change before it happens and adding the words
+ * around it back afterwards. Words are made of the Scintilla word characters, and in
+ * UTF-8 documents of the non-ASCII letters, numbers and marks like Scintilla does.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "wordindex.h"
+
+#include "sciwrappers.h"
+
+#include <string.h>
+
+
+/* changes bigger than this just mark the index for rebuilding on next use, so
+ * e.g. reloading a document doesn't update the words one by one */
+#define MAX_UPDATE_LENGTH 65536
+
+
+typedef struct
+{
+	gchar *word;
+	gint count;
+}
+WordEntry;
+
+struct WordIndex
+{
+	GPtrArray *entries;		/* WordEntry's sorted by word */
+	gchar *word_chars;		/* the Scintilla word characters the index was built for */
+	gboolean is_word_char[256];
+	gboolean utf8;			/* whether the document was UTF-8 when the index was built */
+	gboolean stale;			/* whether it needs to be built again before use */
+};
+
+
+static void word_entry_free(gpointer data)
+{
+	WordEntry *entry = data;
+
+	g_free(entry->word);
+	g_slice_free(WordEntry, entry);
+}
+
+
+WordIndex *word_index_new(void)
+{
+	WordIndex *index = g_new0(WordIndex, 1);
+
+	index->entries = g_ptr_array_new_with_free_func(word_entry_free);
+	index->stale = TRUE;
+	return index;
+}
+
+
+void word_index_free(WordIndex *index)
+{
+	if (! index)
+		return;
+
+	g_ptr_array_free(index->entries, TRUE);
+	g_free(index->word_chars);
+	g_free(index);
+}
+
+
+static gchar *get_word_chars(ScintillaObject *sci)
+{
+	gint len = (gint) scintilla_send_message(sci, SCI_GETWORDCHARS, 0, 0);
+	gchar *word_chars = g_malloc0(len + 1);
+
+	scintilla_send_message(sci, SCI_GETWORDCHARS, 0, (sptr_t) word_chars);
+	return word_chars;
+}
+
+
+/* Gets whether the character at text is a word character like Scintilla classifies it,
+ * and its length in *len */
+static gboolean is_word_char_at(WordIndex *index, const gchar *text, const gchar *end, gint *len)
+{
+	gunichar c;
+
+	*len = 1;
+	if (! index->utf8 || (guchar) *text < 0x80)
+		return index->is_word_char[(guchar) *text];
+
+	c = g_utf8_get_char_validated(text, end - text);
+	if (c == (gunichar) -1 || c == (gunichar) -2)
+		return FALSE;
+	*len = g_utf8_skip[(guchar) *text];
+	return g_unichar_isalnum(c) || g_unichar_ismark(c);
+}
+
+
+/* Gets the next word in text, returns NULL if there is none */
+static const gchar *next_word(WordIndex *index, const gchar *text, const gchar *end,
+		gsize *word_len)
+{
+	const gchar *word;
+	gint len;
+
+	while (text < end && ! is_word_char_at(index, text, end, &len))
+		text += len;
+	if (text >= end)
+		return NULL;
+
+	word = text;
+	while (text < end && is_word_char_at(index, text, end, &len))
+		text += len;
+	*word_len = text - word;
+	return word;
+}
+
+
+/* Compares the word of an entry with the len bytes of word */
+static gint compare_word(const WordEntry *entry, const gchar *word, gsize len)
+{
+	gint cmp = strncmp(entry->word, word, len);
+
+	if (cmp == 0 && entry->word[len] != '\0')
+		return 1;
+	return cmp;
+}
+
+
+/* Gets the index of the first entry not less than the len bytes of word */
+static guint find_entry(WordIndex *index, const gchar *word, gsize len)
+{
+	guint lower = 0, upper = index->entries->len;
+
+	while (lower < upper)
+	{
+		guint middle = lower + (upper - lower) / 2;
+
+		if (compare_word(g_ptr_array_index(index->entries, middle), word, len) < 0)
+			lower = middle + 1;
+		else
+			upper = middle;
+	}
+	return lower;
+}
+
+
+static void add_word(WordIndex *index, const gchar *word, gsize len)
+{
+	guint i = find_entry(index, word, len);
+	WordEntry *entry;
+
+	if (i < index->entries->len)
+	{
+		entry = g_ptr_array_index(index->entries, i);
+		if (compare_word(entry, word, len) == 0)
+		{
+			entry->count++;
+			return;
+		}
+	}
+
+	entry = g_slice_new(WordEntry);
+	entry->word = g_strndup(word, len);
+	entry->count = 1;
+
+	/* insert at i, keeping the entries sorted */
+	g_ptr_array_add(index->entries, NULL);
+	memmove(index->entries->pdata + i + 1, index->entries->pdata + i,
+		(index->entries->len - 1 - i) * sizeof(gpointer));
+	index->entries->pdata[i] = entry;
+}
+
+
+static void remove_word(WordIndex *index, const gchar *word, gsize len)
+{
+	guint i = find_entry(index, word, len);
+	WordEntry *entry;
+
+	if (i >= index->entries->len)
+		return;
+
+	entry = g_ptr_array_index(index->entries, i);
+	if (compare_word(entry, word, len) == 0 && --entry->count <= 0)
+		g_ptr_array_remove_index(index->entries, i);
+}
+
+
+/* Calls func for each word in the len bytes of text */
+static void foreach_word(WordIndex *index, const gchar *text, gsize len,
+		void (*func)(WordIndex *index, const gchar *word, gsize len))
+{
+	const gchar *end = text + len;
+	const gchar *word;
+	gsize word_len;
+
+	while ((word = next_word(index, text, end, &word_len)) != NULL)
+	{
+		func(index, word, word_len);
+		text = word + word_len;
+	}
+}
+
+
+static gint compare_entries(gconstpointer a, gconstpointer b)
+{
+	const WordEntry *entry_a = *((const WordEntry **) a);
+	const WordEntry *entry_b = *((const WordEntry **) b);
+
+	return strcmp(entry_a->word, entry_b->word);
+}
+
+
+static void build(WordIndex *index, ScintillaObject *sci)
+{
+	GHashTable *table = g_hash_table_new(g_str_hash, g_str_equal);
+	GHashTableIter iter;
+	GString *word = g_string_new(NULL);
+	gpointer entry;
+	const gchar *text, *end, *start;
+	const gchar *p;
+	gsize word_len;
+	gint len;
+	guint i;
+
+	g_ptr_array_set_size(index->entries, 0);
+	g_free(index->word_chars);
+	index->word_chars = get_word_chars(sci);
+	memset(index->is_word_char, 0, sizeof index->is_word_char);
+	for (p = index->word_chars; *p; p++)
+		index->is_word_char[(guchar) *p] = TRUE;
+	index->utf8 = scintilla_send_message(sci, SCI_GETCODEPAGE, 0, 0) == SC_CP_UTF8;
+
+	/* count the words in a hash table first rather than inserting them in sorted order
+	 * one by one.
+	 * Warning: any SCI calls will invalidate 'text' */
+	len = sci_get_length(sci);
+	text = (void*)scintilla_send_message(sci, SCI_GETRANGEPOINTER, 0, len);
+	end = text + len;
+	while ((start = next_word(index, text, end, &word_len)) != NULL)
+	{
+		text = start + word_len;
+		g_string_truncate(word, 0);
+		g_string_append_len(word, start, word_len);
+		entry = g_hash_table_lookup(table, word->str);
+		if (entry)
+			((WordEntry *) entry)->count++;
+		else
+		{
+			WordEntry *new_entry = g_slice_new(WordEntry);
+
+			new_entry->word = g_strndup(word->str, word->len);
+			new_entry->count = 1;
+			g_hash_table_insert(table, new_entry->word, new_entry);
+		}
+	}
+	g_string_free(word, TRUE);
+
+	g_ptr_array_set_size(index->entries, g_hash_table_size(table));
+	i = 0;
+	g_hash_table_iter_init(&iter, table);
+	while (g_hash_table_iter_next(&iter, NULL, &entry))
+		index->entries->pdata[i++] = entry;
+	g_hash_table_destroy(table);
+	g_ptr_array_sort(index->entries, compare_entries);
+
+	index->stale = FALSE;
+}
+
+
+/* Updates the index for a change of the text from start to end, extended to the words
+ * around it.
+ * @param add FALSE to remove the words before the change, TRUE to add them after it. */
+void word_index_update(WordIndex *index, ScintillaObject *sci, gint start, gint end, gboolean add)
+{
+	const gchar *text;
+
+	g_return_if_fail(index != NULL);
+
+	if (index->stale)
+		return;
+	if (end - start > MAX_UPDATE_LENGTH)
+	{
+		index->stale = TRUE;
+		return;
+	}
+
+	/* the word boundaries of Scintilla are the same as ours */
+	start = sci_word_start_position(sci, start, TRUE);
+	end = sci_word_end_position(sci, end, TRUE);
+
+	/* Warning: any SCI calls will invalidate 'text' */
+	text = (void*)scintilla_send_message(sci, SCI_GETRANGEPOINTER, start, end - start);
+	foreach_word(index, text, end - start, add ? add_word : remove_word);
+}
+
+
+/* Gets the words starting with root and longer than it, in strcmp() order.
+ * @param exclude A word occurrence not to count, e.g. the word being completed, or NULL.
+ * @param max_words The maximum number of words to get.
+ * @return A list of newly allocated words. */
+GSList *word_index_find(WordIndex *index, ScintillaObject *sci, const gchar *root,
+		gsize rootlen, const gchar *exclude, guint max_words)
+{
+	GSList *words = NULL;
+	guint i, n_words = 0;
+
+	g_return_val_if_fail(index != NULL, NULL);
+
+	if (! index->stale)
+	{
+		gchar *word_chars = get_word_chars(sci);
+
+		/* the word characters change with the filetype, and the classes of non-ASCII
+		 * characters with the encoding */
+		index->stale = g_strcmp0(word_chars, index->word_chars) != 0 ||
+			index->utf8 != (scintilla_send_message(sci, SCI_GETCODEPAGE, 0, 0) == SC_CP_UTF8);
+		g_free(word_chars);
+	}
+	if (index->stale)
+		build(index, sci);
+
+	for (i = find_entry(index, root, rootlen);
+		i < index->entries->len && n_words < max_words; i++)
+	{
+		WordEntry *entry = g_ptr_array_index(index->entries, i);
+
+		if (strncmp(entry->word, root, rootlen) != 0)
+			break;
+		if (entry->word[rootlen] == '\0' ||
+			(entry->count <= 1 && g_strcmp0(entry->word, exclude) == 0))
+			continue;
+
+		words = g_slist_prepend(words, g_strdup(entry->word));
+		n_words++;
+	}
+	return g_slist_reverse(words);
+}
@@ -0,0 +1,44 @@
+/*
+ *      wordindex.h - this file is part of Geany, a fast and lightweight IDE
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef GEANY_WORDINDEX_H
+#define GEANY_WORDINDEX_H 1
+
+#include "gtkcompat.h" /* Needed by ScintillaWidget.h */
+#include "Scintilla.h" /* Needed by ScintillaWidget.h */
+#include "ScintillaWidget.h" /* for ScintillaObject */
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct WordIndex WordIndex;
+
+WordIndex *word_index_new(void);
+
+void word_index_free(WordIndex *index);
+
+void word_index_update(WordIndex *index, ScintillaObject *sci, gint start, gint end, gboolean add);
+
+GSList *word_index_find(WordIndex *index, ScintillaObject *sci, const gchar *root,
+		gsize rootlen, const gchar *exclude, guint max_words);
+
+G_END_DECLS
+
+#endif /* GEANY_WORDINDEX_H */